@@ -0,0 +1,356 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+/**
+ * Microbenchmarks of the receive path, on synthetic ASDUs built with the lib60870
+ * ASDU constructors :
+ *   lookup/<points>        Label lookup (m_checkExchangedDataLayer), 10 to 1M points
+ *   decode/<TypeID>        m_asduReceivedHandler on a full ASDU, up to the ingest queue
+ *   add_data/<kind>        Pivot data_object_item of one element (m_addData)
+ *   send_data/<TypeID>     Pivot Readings of a full ASDU, freed by the ingest callback
+ *   decode+stats/<TypeID>, send_data+stats/<TypeID>
+ *                          The same with latency_stats : the overhead of the stage histograms
+ *   time/<kind>            CP56Time2a formatting and conversion
+ * Each benchmark reports ns and heap allocations per element, allocations being
+ * counted on the benchmark thread by the malloc, calloc and realloc of this file :
+ * they interpose the ones of glibc, so that operator new and the C allocations of
+ * lib60870 are counted too. posix_memalign, aligned_alloc and mmap are not counted.
+ *
+ * Usage : iec104_bench [name filter] [--max-points n] [--min-time ms]
+ */
+
+#include <iec104.h>
+#include "iec104_simulator.h"
+#include <json.hpp> // https://github.com/nlohmann/json
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+using namespace nlohmann;
+
+
+// ==================================================================== //
+// Allocation counter
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+
+// No constructor, so that the first allocation of a thread does not allocate its counter
+static thread_local uint64_t allocations = 0;
+
+extern "C" void* malloc(size_t size)
+{
+    allocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    allocations++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* p, size_t size)
+{
+    allocations++;
+    return __libc_realloc(p, size);
+}
+
+
+// ==================================================================== //
+
+#define STACK_CONF QUOTE({\
+    "protocol_stack":{\
+       "transport_layer":{\
+          "connection":{ "path":[ { "srv_ip":"127.0.0.1", "port":2404 } ], "tls":false },\
+          "llevel":4, "k_value":12, "w_value":8,\
+          "t0_timeout":10, "t1_timeout":15, "t2_timeout":10, "t3_timeout":20,\
+          "conn_all":true, "conn_passv":false\
+       },\
+       "application_layer":{\
+          "orig_addr":0, "ca_asdu_size":2, "ioaddr_size":3, "startup_time":180, "asdu_size":0,\
+          "gi_time":60, "gi_cycle":false, "gi_all_ca":false, "gi_repeat_count":2, "tsiv":"PROCESS",\
+          "comm_wttag":true, "exec_cycl_test":false, "startup_state":true, "time_sync":false,\
+          "ingest_queue_size":65536\
+       }\
+    }\
+})
+
+#define TRANSLATION_CONF QUOTE({\
+    "protocol_translation":{\
+       "mapping":{\
+          "data_object_header":{\
+             "doh_type":"type_id", "doh_ca":"ca", "doh_oa":"oa", "doh_cot":"cot",\
+             "doh_test":"istest", "doh_negative":"isnegative"\
+          },\
+          "data_object_item":{\
+             "doi_ioa":"ioa", "doi_value":"value", "doi_quality":"quality_desc", "doi_ts":"time_marker",\
+             "doi_ts_flag1":"isinvalid", "doi_ts_flag2":"isSummerTime", "doi_ts_flag3":"isSubstituted"\
+          }\
+       }\
+    }\
+})
+
+static const char* TYPE_IDS[] = {
+    "M_SP_NA_1", "M_SP_TA_1", "M_SP_TB_1", "M_DP_NA_1", "M_DP_TA_1", "M_DP_TB_1",
+    "M_ST_NA_1", "M_ST_TA_1", "M_ST_TB_1", "M_BO_NA_1", "M_BO_TA_1", "M_BO_TB_1",
+    "M_ME_NA_1", "M_ME_TA_1", "M_ME_TD_1", "M_ME_NB_1", "M_ME_TB_1", "M_ME_TE_1",
+    "M_ME_NC_1", "M_ME_TC_1", "M_ME_TF_1", "M_IT_NA_1", "M_IT_TA_1", "M_IT_TB_1"
+};
+static const size_t TYPE_COUNT = sizeof(TYPE_IDS) / sizeof(TYPE_IDS[0]);
+
+// Points of the configurations, spread over the TypeIDs and over CAs of 65536 IOAs each
+static const unsigned int FIRST_CA = 1;
+
+static string filter;
+static int min_time_ms = 200;
+
+
+/** Access to the private receive path of the plugin */
+class IEC104Bench
+{
+public:
+    static bool receive(IEC104Client* client, CS101_ASDU asdu)
+    { return IEC104::m_asduReceivedHandler(client, 0, asdu); }
+
+    static const IEC104DataPoint* lookup(const IEC104Config& config, unsigned int ca, int type_id, unsigned int ioa)
+    { return IEC104::m_checkExchangedDataLayer(config, ca, type_id, ioa); }
+
+    static size_t drain(IEC104Client& client, vector<IEC104DataRecord>* records = nullptr)
+    {
+        IEC104DataRecord record;
+        size_t count = 0;
+        while (client.m_queue.tryPop(record))
+        {
+            if (records != nullptr)
+                records->push_back(record);
+            count++;
+        }
+        return count;
+    }
+};
+
+
+/** Run f, which handles elements elements, for at least min_time_ms and print the cost per element */
+template <class F>
+static void measure(const string& name, size_t elements, F f)
+{
+    if (!filter.empty() && name.find(filter) == string::npos)
+        return;
+
+    f();
+
+    uint64_t calls = 0;
+    uint64_t allocations_start = allocations;
+    auto start = chrono::steady_clock::now();
+    chrono::nanoseconds elapsed;
+
+    do
+    {
+        f();
+        calls++;
+        elapsed = chrono::steady_clock::now() - start;
+    }
+    while (elapsed < chrono::milliseconds(min_time_ms));
+
+    double total = (double) calls * elements;
+    printf("%-24s %12.1f ns/element %10.2f allocs/element\n", name.c_str(),
+           elapsed.count() / total, (allocations - allocations_start) / total);
+    fflush(stdout);
+}
+
+
+static string exchangedData(size_t points)
+{
+    string asdu_list;
+    asdu_list.reserve(points * 80);
+
+    for (size_t i = 0; i < points; i++)
+    {
+        if (i > 0)
+            asdu_list += ",";
+        asdu_list += "{\"ca\":" + to_string(FIRST_CA + i / 65536) + ",\"type_id\":\"" + TYPE_IDS[i % TYPE_COUNT]
+                   + "\",\"label\":\"P-" + to_string(i) + "\",\"ioa\":" + to_string(i % 65536) + "}";
+    }
+    return "{\"exchanged_data\":{\"asdu_list\":[" + asdu_list + "]}}";
+}
+
+
+static shared_ptr<const IEC104Config> parseConfig(size_t points, bool latency_stats = false)
+{
+    json stack = json::parse(STACK_CONF);
+    stack["protocol_stack"]["application_layer"]["latency_stats"] = latency_stats;
+    return IEC104Config::parse(stack.dump(), exchangedData(points), TRANSLATION_CONF, "{}");
+}
+
+
+static void freeReadings(void*, vector<Reading*>* readings)
+{
+    for (Reading* reading : *readings)
+        delete reading;
+}
+
+
+/** ASDU of type_id, as full as lib60870 allows, with the points of that type in config */
+static CS101_ASDU createAsdu(const IEC104Config& config, int type_id)
+{
+    static sCS101_AppLayerParameters parameters = {1, 1, 2, 0, 2, 3, 249};
+
+    CS101_ASDU asdu = CS101_ASDU_create(&parameters, false, CS101_COT_SPONTANEOUS, 0, FIRST_CA, false, false);
+    uint64_t now_ms = Hal_getTimeInMs();
+
+    for (auto& point : config.points)
+    {
+        if (point.type_id != type_id || point.ca != FIRST_CA)
+            continue;
+
+        InformationObject io = IEC104Simulator::createObject(IEC104SimulatorPoint{point.ca, type_id, point.ioa},
+                                                             point.id, now_ms);
+        bool added = CS101_ASDU_addInformationObject(asdu, io);
+        InformationObject_destroy(io);
+        if (!added)
+            break;
+    }
+    return asdu;
+}
+
+
+static void benchLookup(size_t points)
+{
+    string name = "lookup/" + to_string(points);
+    if (!filter.empty() && name.find(filter) == string::npos)
+        return;
+
+    shared_ptr<const IEC104Config> config = parseConfig(points);
+
+    // Random existing points, so that the lookups do not all hit the same cache lines
+    const size_t keys = 4096;
+    vector<const IEC104DataPoint*> targets(keys);
+    srand(1);
+    for (auto& target : targets)
+        target = &config->points[rand() % points];
+
+    measure(name, keys, [&config, &targets]()
+    {
+        size_t found = 0;
+        for (auto* target : targets)
+            found += IEC104Bench::lookup(*config, target->ca, target->type_id, target->ioa) != nullptr;
+        if (found != targets.size())
+            abort();
+    });
+}
+
+
+int main(int argc, char** argv)
+{
+    size_t max_points = 1000000;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--max-points") == 0 && i + 1 < argc)
+            max_points = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+            min_time_ms = atoi(argv[++i]);
+        else if (argv[i][0] != '-')
+            filter = argv[i];
+        else
+        {
+            fprintf(stderr, "Usage : %s [name filter] [--max-points n] [--min-time ms]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    Logger::getLogger()->setMinLevel("error");
+
+    for (size_t points = 10; points <= max_points; points *= 10)
+        benchLookup(points);
+
+    // 127 points of each TypeID on the first CA, enough to fill an ASDU of any type
+    shared_ptr<const IEC104Config> config = parseConfig(127 * TYPE_COUNT);
+    shared_ptr<const IEC104Config> stats_config = parseConfig(127 * TYPE_COUNT, true);
+
+    IEC104 iec104;
+    iec104.registerIngestV2(nullptr, freeReadings);
+
+    // The workers are not started : the benchmark drains the ingest queues itself
+    IEC104Client client(&iec104, config);
+    IEC104Client stats_client(&iec104, stats_config);
+
+    auto benchReceive = [](const string& suffix, IEC104Client& client, CS101_ASDU asdu, const char* type_name)
+    {
+        size_t elements = CS101_ASDU_getNumberOfElements(asdu);
+
+        measure("decode" + suffix + "/" + type_name, elements, [&client, asdu]()
+        {
+            IEC104Bench::receive(&client, asdu);
+            IEC104Bench::drain(client);
+        });
+
+        vector<IEC104DataRecord> records;
+        IEC104Bench::receive(&client, asdu);
+        IEC104Bench::drain(client, &records);
+
+        measure("send_data" + suffix + "/" + type_name, records.size(), [&client, &records]()
+        {
+            client.sendData(records.data(), records.size());
+        });
+    };
+
+    for (const char* type_name : TYPE_IDS)
+    {
+        CS101_ASDU asdu = createAsdu(*config, IEC104Config::getTypeIdFromString(type_name));
+        benchReceive("", client, asdu, type_name);
+        benchReceive("+stats", stats_client, asdu, type_name);
+        CS101_ASDU_destroy(asdu);
+    }
+
+    sCP56Time2a ts;
+    CP56Time2a_createFromMsTimestamp(&ts, Hal_getTimeInMs());
+    vector<Datapoint*> datapoints;
+
+    auto addData = [&client, &datapoints](bool is_float, CP56Time2a ts)
+    {
+        for (int i = 0; i < 100; i++)
+        {
+            if (is_float)
+                client.addData(datapoints, 4202832, "P-0", (float) i, 0, ts);
+            else
+                client.addData(datapoints, 4202832, "P-0", (long) i, 0, ts);
+        }
+        for (Datapoint* datapoint : datapoints)
+            delete datapoint;
+        datapoints.clear();
+    };
+    measure("add_data/float_ts", 100, [&addData, &ts]() { addData(true, &ts); });
+    measure("add_data/long_ts", 100, [&addData, &ts]() { addData(false, &ts); });
+    measure("add_data/long", 100, [&addData]() { addData(false, nullptr); });
+
+    IEC104TimeFormatter formatter;
+    char buffer[IEC104TimeFormatter::LENGTH];
+    vector<sCP56Time2a> same_minute(100), every_minute(100);
+    uint64_t now_ms = Hal_getTimeInMs();
+    for (int i = 0; i < 100; i++)
+    {
+        CP56Time2a_createFromMsTimestamp(&same_minute[i], now_ms - now_ms % 60000 + i * 10);
+        CP56Time2a_createFromMsTimestamp(&every_minute[i], now_ms + i * 60000);
+    }
+
+    volatile int64_t sink = 0;
+    measure("time/format_same_minute", 100, [&]() { for (auto& t : same_minute) sink += formatter.format(&t, buffer); });
+    measure("time/format_every_minute", 100, [&]() { for (auto& t : every_minute) sink += formatter.format(&t, buffer); });
+    measure("time/epoch_same_minute", 100, [&]() { for (auto& t : same_minute) sink += formatter.toEpochMs(&t, true); });
+    measure("time/epoch_every_minute", 100, [&]() { for (auto& t : every_minute) sink += formatter.toEpochMs(&t, true); });
+
+    return 0;
+}
@@ -0,0 +1,375 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+/**
+ * End-to-end throughput benchmark of the plugin shared library, loaded with dlopen
+ * and driven through its C entry points as the Fledge south service does :
+ * plugin_init, plugin_register_ingest, plugin_start and plugin_shutdown. The ingest
+ * callback only counts the readings and measures their latency from the time tag
+ * set by the outstation. The outstation is the simulator, run in a child process so
+ * that its CPU time is not accounted to the plugin.
+ *
+ * For each combination of points, ASDU fill factor (information objects per ASDU,
+ * 0 for full ASDUs) and paths to the outstation, it reports the readings/s sustained
+ * after a warm-up, the end-to-end latency percentiles, the CPU time per 10k readings
+ * and the peak resident set size of the process during the scenario, sampled every 100 ms.
+ *
+ * Usage : iec104_e2e_bench [--plugin libiec104.so] [--points n,...] [--fill n,...]
+ *                          [--paths n,...] [--rate values/s] [--warmup s] [--duration s]
+ *                          [--port port]
+ */
+
+#include <config_category.h>
+#include <logger.h>
+#include <plugin_api.h>
+#include <reading.h>
+#include <iec104_config.h>
+#include <iec104_latency.h>
+#include "iec104_simulator.h"
+
+#include <json.hpp> // https://github.com/nlohmann/json
+
+#include <dlfcn.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+using namespace std;
+using namespace nlohmann;
+
+#ifndef IEC104_PLUGIN_PATH
+#define IEC104_PLUGIN_PATH "libiec104.so"
+#endif
+
+typedef void (*INGEST_CB)(void *, Reading);
+typedef void (*INGEST_CB2)(void *, std::vector<Reading *>*);
+
+// Entry points of the plugin
+typedef PLUGIN_HANDLE (*PluginInit)(ConfigCategory*);
+typedef void (*PluginStart)(PLUGIN_HANDLE*);
+typedef void (*PluginShutdown)(PLUGIN_HANDLE*);
+#ifdef FLEDGE_INGEST_V2
+typedef void (*PluginRegisterIngest)(PLUGIN_HANDLE*, INGEST_CB2, void*);
+#else
+typedef void (*PluginRegisterIngest)(PLUGIN_HANDLE*, INGEST_CB, void*);
+#endif
+
+#define TRANSLATION_CONF QUOTE({\
+    "protocol_translation":{\
+       "mapping":{\
+          "data_object_header":{\
+             "doh_type":"type_id", "doh_ca":"ca", "doh_oa":"oa", "doh_cot":"cot",\
+             "doh_test":"istest", "doh_negative":"isnegative"\
+          },\
+          "data_object_item":{\
+             "doi_ioa":"ioa", "doi_value":"value", "doi_quality":"quality_desc", "doi_ts":"time_marker",\
+             "doi_ts_flag1":"isinvalid", "doi_ts_flag2":"isSummerTime", "doi_ts_flag3":"isSubstituted"\
+          }\
+       }\
+    }\
+})
+
+// Time tagged measured values, so that each reading carries its sending time (UTC for lib60870)
+static const char* TYPE_ID = "M_ME_TF_1";
+static const unsigned int FIRST_CA = 1;
+
+struct Scenario
+{
+    size_t  points;
+    int     fill;
+    int     paths;
+};
+
+
+// ==================================================================== //
+// Counting ingest callback
+
+static atomic<uint64_t> readings_received(0);
+static IEC104Histogram  latency_us;
+
+static void countReading(const Reading& reading)
+{
+    struct timeval user_ts, now;
+    reading.getUserTimestamp(&user_ts);
+    gettimeofday(&now, nullptr);
+
+    int64_t latency = (now.tv_sec - user_ts.tv_sec) * 1000000LL + (now.tv_usec - user_ts.tv_usec);
+    latency_us.record(latency > 0 ? latency : 0);
+    readings_received.fetch_add(1, memory_order_relaxed);
+}
+
+#ifdef FLEDGE_INGEST_V2
+/** The readings are owned by the callback, the vector by the plugin */
+static void ingest(void*, vector<Reading*>* readings)
+{
+    for (Reading* reading : *readings)
+    {
+        countReading(*reading);
+        delete reading;
+    }
+}
+#else
+static void ingest(void*, Reading reading)
+{
+    countReading(reading);
+}
+#endif
+
+
+// ==================================================================== //
+// Configuration
+
+static string exchangedData(size_t points)
+{
+    string asdu_list;
+    asdu_list.reserve(points * 80);
+
+    for (size_t i = 0; i < points; i++)
+    {
+        if (i > 0)
+            asdu_list += ",";
+        asdu_list += "{\"ca\":" + to_string(FIRST_CA + i / 65536) + ",\"type_id\":\"" + TYPE_ID
+                   + "\",\"label\":\"P-" + to_string(i) + "\",\"ioa\":" + to_string(i % 65536) + "}";
+    }
+    return "{\"exchanged_data\":{\"asdu_list\":[" + asdu_list + "]}}";
+}
+
+
+static string protocolStack(int port, int paths)
+{
+    json path = json::array();
+    for (int i = 0; i < paths; i++)
+        path.push_back({{"srv_ip", "127.0.0.1"}, {"port", port}});
+
+    // comm_wttag : the time tag of the values, in UTC, is the user timestamp the latency is measured from
+    json stack = {{"protocol_stack", {
+        {"name", "iec104client"},
+        {"version", "1.0"},
+        {"transport_layer", {
+            {"connection", {{"path", path}, {"tls", false}}},
+            {"llevel", 1}, {"k_value", 12}, {"w_value", 8},
+            {"t0_timeout", 10}, {"t1_timeout", 15}, {"t2_timeout", 10}, {"t3_timeout", 20},
+            {"conn_all", true}, {"start_all", false}, {"conn_passv", false}
+        }},
+        {"application_layer", {
+            {"orig_addr", 0}, {"ca_asdu_size", 2}, {"ioaddr_size", 3}, {"startup_time", 180},
+            {"asdu_size", 0}, {"gi_time", 60}, {"gi_cycle", false}, {"gi_all_ca", false},
+            {"gi_repeat_count", 2}, {"tsiv", "PROCESS"}, {"utc_time", true},
+            {"comm_wttag", true}, {"exec_cycl_test", false}, {"startup_state", true},
+            {"time_sync", false}, {"ingest_queue_size", 65536}
+        }}
+    }}};
+    return stack.dump();
+}
+
+
+/** Configuration category of the plugin, as built by the south service from the plugin defaults */
+static string categoryContent(const Scenario& scenario, int port)
+{
+    auto item = [](const string& value)
+    {
+        return json{{"description", ""}, {"type", "string"}, {"default", value}, {"value", value}};
+    };
+
+    json category = {
+        {"asset", item("iec104")},
+        {"protocol_stack", item(protocolStack(port, scenario.paths))},
+        {"exchanged_data", item(exchangedData(scenario.points))},
+        {"protocol_translation", item(TRANSLATION_CONF)},
+        {"tls", item("{}")}
+    };
+    return category.dump();
+}
+
+
+// ==================================================================== //
+
+/** Fork a simulator serving the points of scenario, killed by the caller */
+static pid_t startSimulator(const Scenario& scenario, int port, double rate)
+{
+    pid_t pid = fork();
+    if (pid != 0)
+        return pid;
+
+    IEC104SimulatorConfig config;
+    config.port = port;
+    config.asdu_elements = scenario.fill;
+    config.rates[IEC104Config::getTypeIdFromString(TYPE_ID)] = rate;
+
+    IEC104Simulator simulator(config);
+    simulator.loadPoints(exchangedData(scenario.points));
+    simulator.start();
+
+    for (;;)
+        pause();
+}
+
+
+static double cpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+         + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+
+// Resident set size of the process, in kB. ru_maxrss would be the peak of the largest scenario run so far.
+static long residentSetSize()
+{
+    long pages = 0, resident = 0;
+    ifstream statm("/proc/self/statm");
+    statm >> pages >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+/** Sleep for seconds, and return the peak resident set size sampled meanwhile, in kB */
+static long sleepSamplingRss(int seconds, long peak_kb)
+{
+    auto end = chrono::steady_clock::now() + chrono::seconds(seconds);
+    while (chrono::steady_clock::now() < end)
+    {
+        peak_kb = max(peak_kb, residentSetSize());
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+    return max(peak_kb, residentSetSize());
+}
+
+
+static vector<int> parseList(const char* list)
+{
+    vector<int> values;
+    char* end;
+    for (const char* p = list; *p != '\0'; p = *end == ',' ? end + 1 : end)
+    {
+        values.push_back((int) strtol(p, &end, 10));
+        if (end == p)
+            break;
+    }
+    return values;
+}
+
+
+int main(int argc, char** argv)
+{
+    const char* plugin_path = IEC104_PLUGIN_PATH;
+    vector<int> points_list = {100, 10000, 100000};
+    vector<int> fill_list = {1, 8, 0};
+    vector<int> paths_list = {1, 2};
+    double rate = 100000;
+    int warmup_s = 2;
+    int duration_s = 5;
+    int port = 24040;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--plugin") == 0 && has_value)
+            plugin_path = argv[++i];
+        else if (strcmp(argv[i], "--points") == 0 && has_value)
+            points_list = parseList(argv[++i]);
+        else if (strcmp(argv[i], "--fill") == 0 && has_value)
+            fill_list = parseList(argv[++i]);
+        else if (strcmp(argv[i], "--paths") == 0 && has_value)
+            paths_list = parseList(argv[++i]);
+        else if (strcmp(argv[i], "--rate") == 0 && has_value)
+            rate = atof(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && has_value)
+            warmup_s = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--duration") == 0 && has_value)
+            duration_s = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--port") == 0 && has_value)
+            port = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "Usage : %s [--plugin libiec104.so] [--points n,...] [--fill n,...] [--paths n,...]\n"
+                            "       [--rate values/s] [--warmup s] [--duration s] [--port port]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    void* library = dlopen(plugin_path, RTLD_NOW);
+    if (library == nullptr)
+    {
+        fprintf(stderr, "Couldn't load %s : %s\n", plugin_path, dlerror());
+        return 1;
+    }
+
+    auto init = (PluginInit) dlsym(library, "plugin_init");
+    auto registerIngest = (PluginRegisterIngest) dlsym(library, "plugin_register_ingest");
+    auto start = (PluginStart) dlsym(library, "plugin_start");
+    auto shutdown = (PluginShutdown) dlsym(library, "plugin_shutdown");
+    if (!init || !registerIngest || !start || !shutdown)
+    {
+        fprintf(stderr, "%s is not a south plugin : %s\n", plugin_path, dlerror());
+        return 1;
+    }
+
+    Logger::getLogger()->setMinLevel("error");
+
+    printf("%-8s %-5s %-6s %12s %10s %10s %10s %10s %14s %12s\n", "points", "fill", "paths", "readings/s",
+           "p50 ms", "p99 ms", "p99.9 ms", "max ms", "CPU ms/10k", "peak RSS kB");
+
+    for (int points : points_list)
+    for (int fill : fill_list)
+    for (int paths : paths_list)
+    {
+        Scenario scenario{(size_t) points, fill, paths};
+
+        // A port per scenario, so that the sockets of the previous one in TIME_WAIT do not matter
+        pid_t simulator = startSimulator(scenario, port, rate);
+        this_thread::sleep_for(chrono::milliseconds(200));
+
+        ConfigCategory config("iec104", categoryContent(scenario, port++));
+        PLUGIN_HANDLE handle = init(&config);
+        registerIngest((PLUGIN_HANDLE*) handle, ingest, nullptr);
+        start((PLUGIN_HANDLE*) handle);
+
+        // Connection and station interrogation are not part of the measure, but of the peak RSS of the scenario
+        long peak_rss_kb = sleepSamplingRss(warmup_s, 0);
+
+        latency_us.reset();
+        uint64_t received_start = readings_received.load();
+        double cpu_start = cpuSeconds();
+        auto time_start = chrono::steady_clock::now();
+
+        peak_rss_kb = sleepSamplingRss(duration_s, peak_rss_kb);
+
+        uint64_t received = readings_received.load() - received_start;
+        double cpu = cpuSeconds() - cpu_start;
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - time_start).count();
+
+        shutdown((PLUGIN_HANDLE*) handle);
+        kill(simulator, SIGKILL);
+        waitpid(simulator, nullptr, 0);
+
+        printf("%-8d %-5d %-6d %12.0f %10.1f %10.1f %10.1f %10.1f %14.1f %12ld\n", points, fill, paths,
+               received / elapsed, latency_us.percentile(50) / 1e3, latency_us.percentile(99) / 1e3,
+               latency_us.percentile(99.9) / 1e3, latency_us.max() / 1e3,
+               received > 0 ? cpu * 1e3 * 10000 / received : 0.0, peak_rss_kb);
+        fflush(stdout);
+    }
+
+    dlclose(library);
+    return 0;
+}
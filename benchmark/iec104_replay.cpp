@@ -0,0 +1,120 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+/**
+ * Offline replay of a raw APDU capture (transport_layer/capture_file) through the
+ * decoder and the pivot translation, with no socket : the same traffic gives the
+ * same readings, for performance regression tests and profiling. The plugin is
+ * configured with the json files of its configuration items, and does not connect.
+ *
+ * Usage : iec104_replay <capture> <protocol_stack.json> <exchanged_data.json>
+ *                       <protocol_translation.json> [--speed n] [--repeat n]
+ *   --speed <n>     n times faster than captured, as fast as possible by default (0)
+ *   --repeat <n>    Replay the capture n times
+ */
+
+#include <iec104.h>
+#include <json.hpp> // https://github.com/nlohmann/json
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+using namespace nlohmann;
+
+
+static atomic<uint64_t> readings_received(0);
+
+static void countReadings(void*, vector<Reading*>* readings)
+{
+    readings_received.fetch_add(readings->size(), memory_order_relaxed);
+    for (Reading* reading : *readings)
+        delete reading;
+}
+
+
+static bool readFile(const char* path, string& content)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        fprintf(stderr, "Couldn't open %s\n", path);
+        return false;
+    }
+    stringstream buffer;
+    buffer << file.rdbuf();
+    content = buffer.str();
+    return true;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 5)
+    {
+        fprintf(stderr, "Usage : %s <capture> <protocol_stack.json> <exchanged_data.json> <protocol_translation.json>\n"
+                        "       [--speed n] [--repeat n]\n", argv[0]);
+        return 2;
+    }
+
+    double speed = 0;
+    int repeat = 1;
+    for (int i = 5; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "--speed") == 0)
+            speed = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "--repeat") == 0)
+            repeat = atoi(argv[i + 1]);
+    }
+
+    string stack, exchanged_data, translation;
+    if (!readFile(argv[2], stack) || !readFile(argv[3], exchanged_data) || !readFile(argv[4], translation))
+        return 1;
+
+    // No connection is attempted : the capture is the only source
+    try
+    {
+        json stack_json = json::parse(stack);
+        stack_json["protocol_stack"]["application_layer"]["startup_state"] = false;
+        stack_json["protocol_stack"]["transport_layer"]["conn_passv"] = false;
+        stack_json["protocol_stack"]["transport_layer"].erase("capture_file");
+        stack = stack_json.dump();
+
+        IEC104::setJsonConfig(stack, exchanged_data, translation, "{}");
+    }
+    catch (exception& e)
+    {
+        fprintf(stderr, "Invalid configuration : %s\n", e.what());
+        return 1;
+    }
+
+    IEC104 iec104;
+    iec104.registerIngestV2(nullptr, countReadings);
+    iec104.start();
+
+    auto start = chrono::steady_clock::now();
+    uint64_t asdus = 0;
+    for (int i = 0; i < repeat; i++)
+        asdus += iec104.replay(argv[1], speed);
+
+    // replay() returns once the readings of the last ASDUs are ingested
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    iec104.stop();
+
+    uint64_t readings = readings_received.load();
+    printf("%llu ASDUs, %llu readings in %.3f s : %.0f ASDUs/s, %.0f readings/s\n",
+           (unsigned long long) asdus, (unsigned long long) readings, elapsed, asdus / elapsed, readings / elapsed);
+    return asdus > 0 ? 0 : 1;
+}
@@ -0,0 +1,174 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+/**
+ * Soak benchmark of the ingest path : pushes millions of ASDUs worth of decoded
+ * information objects through an IEC104Client, with an ingest callback that
+ * frees the Readings, and checks that the resident set size stays flat.
+ *
+ * Usage : iec104_soak [number of ASDUs] [information objects per ASDU]
+ */
+
+#include <iec104.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
+using namespace std;
+
+#define STACK_CONF QUOTE({\
+    "protocol_stack":{\
+       "transport_layer":{\
+          "connection":{ "path":[ { "srv_ip":"127.0.0.1", "port":2404 } ], "tls":false },\
+          "llevel":1, "k_value":12, "w_value":8,\
+          "t0_timeout":10, "t1_timeout":15, "t2_timeout":10, "t3_timeout":20,\
+          "conn_all":true, "conn_passv":false\
+       },\
+       "application_layer":{\
+          "orig_addr":0, "ca_asdu_size":2, "ioaddr_size":3, "startup_time":180, "asdu_size":0,\
+          "gi_time":60, "gi_cycle":false, "gi_all_ca":false, "gi_repeat_count":2, "tsiv":"REMOVE",\
+          "comm_wttag":true, "exec_cycl_test":false, "startup_state":true, "time_sync":false,\
+          "ingest_queue_size":65536\
+       }\
+    }\
+})
+
+#define TRANSLATION_CONF QUOTE({\
+    "protocol_translation":{\
+       "mapping":{\
+          "data_object_header":{\
+             "doh_type":"type_id", "doh_ca":"ca", "doh_oa":"oa", "doh_cot":"cot",\
+             "doh_test":"istest", "doh_negative":"isnegative"\
+          },\
+          "data_object_item":{\
+             "doi_ioa":"ioa", "doi_value":"value", "doi_quality":"quality_desc", "doi_ts":"time_marker",\
+             "doi_ts_flag1":"isinvalid", "doi_ts_flag2":"isSummerTime", "doi_ts_flag3":"isSubstituted"\
+          }\
+       }\
+    }\
+})
+
+static const unsigned int CA = 41025;
+static const unsigned int FIRST_IOA = 4202832;
+
+
+static string exchangedData(int points)
+{
+    string asdu_list;
+    for (int i = 0; i < points; i++)
+    {
+        if (i > 0)
+            asdu_list += ",";
+        asdu_list += "{\"ca\":" + to_string(CA) + ",\"type_id\":\"M_ME_TF_1\",\"label\":\"TM-" + to_string(i)
+                   + "\",\"ioa\":" + to_string(FIRST_IOA + i) + "}";
+    }
+    return "{\"exchanged_data\":{\"asdu_list\":[" + asdu_list + "]}}";
+}
+
+
+// Resident set size of the process, in kB
+static long residentSetSize()
+{
+    long pages = 0, resident = 0;
+    ifstream statm("/proc/self/statm");
+    statm >> pages >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+static void freeReadings(void*, vector<Reading*>* readings)
+{
+    for (Reading* reading : *readings)
+        delete reading;
+}
+
+
+int main(int argc, char** argv)
+{
+    long asdus = argc > 1 ? atol(argv[1]) : 5000000;
+    int per_asdu = argc > 2 ? atoi(argv[2]) : 8;
+
+    if (asdus < 10 || per_asdu < 1 || per_asdu > 127)
+    {
+        fprintf(stderr, "usage: %s [number of ASDUs >= 10] [information objects per ASDU, 1 to 127]\n", argv[0]);
+        return 2;
+    }
+
+    shared_ptr<const IEC104Config> config;
+    try
+    {
+        config = IEC104Config::parse(STACK_CONF, exchangedData(per_asdu), TRANSLATION_CONF, "{}");
+    }
+    catch (IEC104ConfigError& e)
+    {
+        fprintf(stderr, "Invalid benchmark configuration: %s\n", e.what());
+        return 2;
+    }
+
+    IEC104 iec104;
+    iec104.registerIngestV2(nullptr, freeReadings);
+
+    IEC104Client client(&iec104, config);
+    client.startWorker();
+
+    IEC104DataRecord record = {};
+    record.ca = CA;
+    record.type_id = M_ME_TF_1;
+    record.cot = CS101_COT_SPONTANEOUS;
+    record.has_timestamp = true;
+
+    // The first tenth of the run warms up the allocator, the rest must not grow
+    long warmup = asdus / 10;
+    long baseline = 0;
+    long peak = 0;
+
+    for (long asdu = 0; asdu < asdus; asdu++)
+    {
+        record.asdu_id = (uint32_t) asdu;
+        CP56Time2a_createFromMsTimestamp(&record.timestamp, Hal_getTimeInMs());
+
+        for (int i = 0; i < per_asdu; i++)
+        {
+            record.point_id = i;
+            record.ioa = FIRST_IOA + i;
+            record.setValue((float) (asdu % 1000 + i));
+            client.push(record);
+        }
+        client.flush();
+
+        if ((asdu + 1) % warmup == 0)
+        {
+            long rss = residentSetSize();
+            if (asdu + 1 == warmup)
+                baseline = rss;
+            else if (rss > peak)
+                peak = rss;
+            printf("%10ld ASDUs  rss %8ld kB  queue depth %zu\n", asdu + 1, rss, client.queueDepth());
+        }
+    }
+
+    client.stopWorker();
+
+    printf("rss after warmup %ld kB, peak %ld kB, queue high water mark %zu/%zu, %llu waits on a full queue\n",
+           baseline, peak, client.queueHighWaterMark(), client.queueCapacity(),
+           (unsigned long long) client.queueFullWaits());
+
+    // Allow for allocator noise, but not for a leak proportional to the number of ASDUs
+    if (peak > baseline + baseline / 10 + 1024)
+    {
+        printf("FAILED: resident set size grew by %ld kB\n", peak - baseline);
+        return 1;
+    }
+
+    printf("OK\n");
+    return 0;
+}
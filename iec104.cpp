@@ -11,22 +11,23 @@
 #include <reading.h>
 #include <logger.h>
 #include <iec104.h>
+#include <iec104_decoder.h>
 #include <fstream>
 #include <iostream>
-#include <cmath>
+#include <algorithm>
+#include <array>
 #include <utility>
+#include <sys/time.h>
 
 
 using namespace std;
-using namespace nlohmann;
 
+// Used by lib60870 to parse the ASDU of a received APDU, but only declared in its internal headers
+extern "C" CS101_ASDU CS101_ASDU_createFromBuffer(CS101_AppLayerParameters parameters, uint8_t* msg, int msgLength);
+
+
+shared_ptr<const IEC104Config> IEC104::m_config;
 
-bool IEC104::m_comm_wttag = false;
-string IEC104::m_tsiv;
-json IEC104::m_stack_configuration;
-json IEC104::m_tls_configuration;
-json IEC104::m_msg_configuration;
-json IEC104::m_pivot_configuration;
 
 
 /** Constructor for the iec104 plugin */
@@ -35,686 +36,1649 @@ IEC104::IEC104() :
 {}
 
 
+/**
+ * Parse and validate the json configuration strings into a new configuration snapshot.
+ * On error, the previous snapshot is kept and IEC104ConfigError is rethrown to the caller.
+ */
 void IEC104::setJsonConfig(const std::string& stack_configuration, const std::string& msg_configuration,
                            const std::string& pivot_configuration, const std::string& tls_configuration)
 {
     Logger::getLogger()->info("Reading json config string...");
 
     try
-    { m_stack_configuration = json::parse(stack_configuration)["protocol_stack"]; }
-    catch (json::parse_error& e)
-    { Logger::getLogger()->fatal("Couldn't read protocol_stack json config string : " + string(e.what())); }
+    {
+        auto config = IEC104Config::parse(stack_configuration, msg_configuration, pivot_configuration, tls_configuration);
+        Logger::getLogger()->info("Configuration loaded with " + to_string(config->points.size()) + " exchanged data points");
+        atomic_store(&m_config, config);
+    }
+    catch (IEC104ConfigError& e)
+    {
+        Logger::getLogger()->fatal("Invalid configuration : " + string(e.what()));
+        throw;
+    }
+}
 
-    try
-    { m_msg_configuration = json::parse(msg_configuration)["exchanged_data"]; }
-    catch (json::parse_error& e)
-    { Logger::getLogger()->fatal("Couldn't read exchanged_data json config string : " + string(e.what())); }
 
-    try
-    { m_pivot_configuration = json::parse(pivot_configuration)["protocol_translation"]; }
-    catch (json::parse_error& e)
-    { Logger::getLogger()->fatal("Couldn't read protocol_translation json config string : " + string(e.what())); }
+/**
+ * Called by the lib60870 thread of a connection. The connection cannot be destroyed
+ * from its own thread, so the state machine of its path runs on the scheduler.
+ */
+void IEC104::m_connectionHandler (void* parameter, CS104_Connection connection, CS104_ConnectionEvent event)
+{
+    auto iec104 = (IEC104*)parameter;
+
+    switch (event)
+    {
+        case CS104_CONNECTION_OPENED:
+            iec104->m_scheduler.schedule(0, [iec104, connection]() { iec104->m_onPathOpened(connection); });
+            break;
+        case CS104_CONNECTION_STARTDT_CON_RECEIVED:
+            iec104->m_scheduler.schedule(0, [iec104, connection]() { iec104->m_onStartDTConfirmed(connection); });
+            break;
+        case CS104_CONNECTION_CLOSED:
+        case CS104_CONNECTION_FAILED:
+            iec104->m_scheduler.schedule(0, [iec104, connection]() { iec104->m_onPathClosed(connection, "connection lost"); });
+            break;
+        default:
+            break;
+    }
+}
+
+
+/**
+ * Decode kernel, compiled once per monitoring TypeID from its IEC104TypeTraits.
+ * Each configured element of the ASDU is pushed to the ingest queue of the client.
+ */
+template <int TYPE_ID>
+void IEC104::m_decodeElements(IEC104Client* client, const IEC104Config& config, CS101_ASDU asdu,
+                              IEC104ElementReader& reader)
+{
+    typedef IEC104TypeTraits<TYPE_ID> Traits;
+
+    IEC104DataRecord record;
+    client->initRecord(record, asdu);
+
+    unsigned int ca = record.ca;
+    int count = CS101_ASDU_getNumberOfElements(asdu);
+
+    for (int i = 0; i < count; i++)
+    {
+        InformationObject io = reader.get(i);
+        if (io == nullptr)
+            continue;
+
+        long ioa = InformationObject_getObjectAddress(io);
+
+        // Timing every lookup would cost as much as the lookup itself, the first one of the ASDU is a sample
+        bool sample = i == 0 && config.application.latency_stats;
+        uint64_t lookup_start_ns = sample ? IEC104LatencyStats::nowNs() : 0;
+        const IEC104DataPoint* point = m_checkExchangedDataLayer(config, ca, TYPE_ID, ioa);
+        if (sample)
+            client->latency().record(IEC104LatencyStage::LOOKUP, TYPE_ID, IEC104LatencyStats::nowNs() - lookup_start_ns);
+
+        if (point == nullptr)
+            continue;
+
+        record.point_id = point->id;
+        record.ioa = ioa;
+        record.setValue(Traits::value(io));
+        record.quality = Traits::quality(io);
+
+        record.has_timestamp = config.application.comm_wttag && Traits::timestamp(io, record.timestamp, config.application.utc_time);
+        if (record.has_timestamp && !config.application.tsiv_process && CP56Time2a_isInvalid(&record.timestamp))
+            continue;
+
+        if (!client->filter(*point, record))
+            continue;
+
+        client->push(record);
+    }
+}
+
+
+/** Jump table of the decode kernels, indexed by TypeID */
+const IEC104::DecodeFunction* IEC104::m_getDecoders()
+{
+    static const array<DecodeFunction, 256> decoders = []()
+    {
+        array<DecodeFunction, 256> decoders{};
+
+        decoders[M_SP_NA_1] = m_decodeElements<M_SP_NA_1>;
+        decoders[M_SP_TA_1] = m_decodeElements<M_SP_TA_1>;
+        decoders[M_SP_TB_1] = m_decodeElements<M_SP_TB_1>;
+        decoders[M_DP_NA_1] = m_decodeElements<M_DP_NA_1>;
+        decoders[M_DP_TA_1] = m_decodeElements<M_DP_TA_1>;
+        decoders[M_DP_TB_1] = m_decodeElements<M_DP_TB_1>;
+        decoders[M_ST_NA_1] = m_decodeElements<M_ST_NA_1>;
+        decoders[M_ST_TA_1] = m_decodeElements<M_ST_TA_1>;
+        decoders[M_ST_TB_1] = m_decodeElements<M_ST_TB_1>;
+        decoders[M_BO_NA_1] = m_decodeElements<M_BO_NA_1>;
+        decoders[M_BO_TA_1] = m_decodeElements<M_BO_TA_1>;
+        decoders[M_BO_TB_1] = m_decodeElements<M_BO_TB_1>;
+        decoders[M_ME_NA_1] = m_decodeElements<M_ME_NA_1>;
+        decoders[M_ME_TA_1] = m_decodeElements<M_ME_TA_1>;
+        decoders[M_ME_TD_1] = m_decodeElements<M_ME_TD_1>;
+        decoders[M_ME_NB_1] = m_decodeElements<M_ME_NB_1>;
+        decoders[M_ME_TB_1] = m_decodeElements<M_ME_TB_1>;
+        decoders[M_ME_TE_1] = m_decodeElements<M_ME_TE_1>;
+        decoders[M_ME_NC_1] = m_decodeElements<M_ME_NC_1>;
+        decoders[M_ME_TC_1] = m_decodeElements<M_ME_TC_1>;
+        decoders[M_ME_TF_1] = m_decodeElements<M_ME_TF_1>;
+        decoders[M_IT_NA_1] = m_decodeElements<M_IT_NA_1>;
+        decoders[M_IT_TA_1] = m_decodeElements<M_IT_TA_1>;
+        decoders[M_IT_TB_1] = m_decodeElements<M_IT_TB_1>;
+
+        return decoders;
+    }();
+
+    return decoders.data();
+}
+
+
+/** Handle ASDU message
+ *  For CS104 the address parameter has to be ignored
+ */
+bool IEC104::m_asduReceivedHandler(void *parameter, int address, CS101_ASDU asdu) {
+    static const DecodeFunction* decoders = m_getDecoders();
+
+    auto mclient = static_cast<IEC104Client *>(parameter);
+    const IEC104Config& config = mclient->config();
+
+    TypeID type_id = CS101_ASDU_getTypeID(asdu);
+
+    DecodeFunction decode = decoders[type_id & 0xff];
+    if (decode != nullptr)
+    {
+        uint64_t received_ns = IEC104LatencyStats::nowNs();
+        Logger::getLogger()->debug("Received %s", TypeID_toString(type_id));
+
+        IEC104ElementReader reader(asdu);
+        decode(mclient, config, asdu, reader);
+        mclient->countDecodedElements(reader.elements(), reader.heapElements());
+        mclient->flush();
+
+        if (config.application.latency_stats)
+            mclient->latency().record(IEC104LatencyStage::DECODE, type_id, IEC104LatencyStats::nowNs() - received_ns);
+    }
+    else
+    {
+        switch (type_id) {
+            case M_EI_NA_1:
+                Logger::getLogger()->info("Received end of initialization");
+                break;
+            case C_IC_NA_1:
+            {
+                Logger::getLogger()->info("General interrogation command");
+
+                // The GI state machine runs on the scheduler thread
+                IEC104* iec104 = mclient->iec104();
+                unsigned int ca = CS101_ASDU_getCA(asdu);
+                int cot = CS101_ASDU_getCOT(asdu);
+                bool negative = CS101_ASDU_isNegative(asdu);
+
+                // Tells a station GI from a group GI of the same CA
+                IEC104ElementReader reader(asdu);
+                InformationObject io = reader.get(0);
+                int qoi = io != nullptr ? InterrogationCommand_getQOI((InterrogationCommand) io) : IEC60870_QOI_STATION;
+
+                iec104->m_scheduler.schedule(0, [iec104, ca, qoi, cot, negative]()
+                                                { iec104->m_onCommandResponse(C_IC_NA_1, ca, qoi, cot, negative); });
+                break;
+            }
+            case C_TS_TA_1:
+            case C_TS_NA_1:
+            {
+                Logger::getLogger()->debug("Test command response");
+
+                IEC104* iec104 = mclient->iec104();
+                unsigned int ca = CS101_ASDU_getCA(asdu);
+                int cot = CS101_ASDU_getCOT(asdu);
+                bool negative = CS101_ASDU_isNegative(asdu);
+                iec104->m_scheduler.schedule(0, [iec104, type_id, ca, cot, negative]()
+                                                { iec104->m_onCommandResponse(type_id, ca, 0, cot, negative); });
+                break;
+            }
+            case C_SC_TA_1:
+                Logger::getLogger()->info("Single command with time tag CP56Time2a");
+                break;
+            case C_DC_TA_1:
+                Logger::getLogger()->info("Double command with time tag CP56Time2a");
+                break;
+            default:
+                Logger::getLogger()->error("Type of message not supported");
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+void IEC104::restart()
+{
+    stop();
+    start();
+}
+
+
+/** Apply the transport and application layer parameters to a new connection */
+void IEC104::m_configureConnection(CS104_Connection connection)
+{
+    const IEC104Config& config = *m_active_config;
+
+	//Transport layer initialization
+    sCS104_APCIParameters apci_parameters = {12, 8, 10, 15, 10, 20}; // default values
+    apci_parameters.k = config.transport.k_value;
+    apci_parameters.w = config.transport.w_value;
+    apci_parameters.t0 = config.transport.t0_timeout;
+    apci_parameters.t1 = config.transport.t1_timeout;
+    apci_parameters.t2 = config.transport.t2_timeout;
+    apci_parameters.t3 = config.transport.t3_timeout;
+
+    CS104_Connection_setAPCIParameters(connection, &apci_parameters);
+
+	// Application layer initialization
+    sCS101_AppLayerParameters app_layer_parameters = m_getAppLayerParameters();
+	CS104_Connection_setAppLayerParameters(connection, &app_layer_parameters);
+
+	Logger::getLogger()->info("Connection initialized");
+}
+
+
+sCS101_AppLayerParameters IEC104::m_getAppLayerParameters() const
+{
+    const IEC104Config& config = *m_active_config;
+
+    sCS101_AppLayerParameters app_layer_parameters = {1,1,
+                                                      2,0,
+                                                      2,3,249}; // default values
+	app_layer_parameters.originatorAddress = config.application.orig_addr;
+	app_layer_parameters.sizeOfCA = config.application.ca_asdu_size; // 2
+	app_layer_parameters.sizeOfIOA = config.application.ioaddr_size; // 3
+    app_layer_parameters.maxSizeOfASDU = config.application.asdu_size;
+
+    return app_layer_parameters;
+}
+
+
+/**
+ * Scheduler task : start connecting a path, without blocking. The outcome is reported
+ * to the connection handler, or by the timeout if lib60870 does not report failures.
+ */
+void IEC104::m_connectPath(unsigned int path_index)
+{
+    IEC104Path& path = m_paths[path_index];
+    CS104_Connection connection = path.connection;
+
+    m_setPathState(path, IEC104PathState::CONNECTING);
+    path.connect_start_ms = IEC104Scheduler::nowMs();
+
+    CS104_Connection_connectAsync(connection);
+
+    uint64_t timeout_ms = 1000 * (uint64_t) m_active_config->transport.t0_timeout + 1000;
+    path.timer = m_scheduler.schedule(timeout_ms, [this, connection]() { m_onPathClosed(connection, "connection timeout"); });
+}
+
+
+/** Scheduler task : the connection of a path is established, start it */
+void IEC104::m_onPathOpened(CS104_Connection connection)
+{
+    int path_index = m_getPathIndex(connection);
+    if (path_index < 0 || m_paths[path_index].state != IEC104PathState::CONNECTING)
+        return;
+
+    IEC104Path& path = m_paths[path_index];
+
+    m_scheduler.cancel(path.timer);
+    m_setPathState(path, IEC104PathState::CONNECTED);
+    path.failures = 0;
+    path.connected_ms = IEC104Scheduler::nowMs();
+
+    // lib60870 does the TLS handshake within the connection, so both are timed together
+	Logger::getLogger()->info("Connection established on path " + to_string(path_index) + " after "
+	                          + to_string(path.connected_ms - path.connect_start_ms) + " ms"
+	                          + (m_active_config->transport.tls ? " (TCP connect and TLS handshake)" : ""));
+
+	// The other paths stay connected in standby, unless start_all is set
+	if (m_active_path < 0 || m_active_config->transport.start_all)
+	    m_startPath(path_index);
+
+    m_checkStartup();
+}
+
+
+/** Send STARTDT on a connected path, then interrogate and synchronise the outstation through it */
+void IEC104::m_startPath(unsigned int path_index)
+{
+    const IEC104Config& config = *m_active_config;
+    IEC104Path& path = m_paths[path_index];
+
+    if (m_active_path < 0)
+    {
+        m_active_path = path_index;
+        Logger::getLogger()->info("Path " + to_string(path_index) + " elected active path");
+    }
+
+    {
+        lock_guard<mutex> lock(m_paths_mutex);
+        path.started = true;
+    }
+    path.startdt_ms = IEC104Scheduler::nowMs();
+    CS104_Connection_sendStartDT(path.connection);
+
+	m_sendInterrogationCommmands();
+
+    if (config.application.time_sync)
+    {
+        Logger::getLogger()->info("Sending clock sync command");
+        sCP56Time2a currentTime{};
+        CP56Time2a_createFromMsTimestamp(&currentTime, Hal_getTimeInMs());
+        CS104_Connection_sendClockSyncCommand(path.connection, config.getBroadcastCA(), &currentTime);
+    }
+}
+
+
+/** Scheduler task : the outstation confirmed the STARTDT of a path */
+void IEC104::m_onStartDTConfirmed(CS104_Connection connection)
+{
+    int path_index = m_getPathIndex(connection);
+    if (path_index < 0 || !m_paths[path_index].started)
+        return;
+
+    IEC104Path& path = m_paths[path_index];
+    path.startdt_con_ms = IEC104Scheduler::nowMs();
+
+    Logger::getLogger()->info("STARTDT confirmed on path " + to_string(path_index) + " after "
+                              + to_string(path.startdt_con_ms - path.startdt_ms) + " ms");
+}
+
+
+/** Elect a connected path to replace the active path that was lost */
+void IEC104::m_electActivePath()
+{
+    m_active_path = -1;
+
+    for (unsigned int i = 0; i < m_paths.size(); i++)
+    {
+        if (m_paths[i].state != IEC104PathState::CONNECTED)
+            continue;
+
+        if (m_paths[i].started)
+        {
+            m_active_path = i;
+            Logger::getLogger()->info("Path " + to_string(i) + " elected active path");
+        }
+        else
+            m_startPath(i);
+        return;
+    }
+
+    Logger::getLogger()->warn("No connected path left to elect as active path");
+}
+
+
+/**
+ * Scheduler task : the connection of a path failed or was lost. Only this path is
+ * reconnected, after a backoff delay, the other paths keep running.
+ */
+void IEC104::m_onPathClosed(CS104_Connection connection, const string& reason)
+{
+    int path_index = m_getPathIndex(connection);
+    if (path_index < 0)
+        return;
+
+    IEC104Path& path = m_paths[path_index];
+    if (path.state != IEC104PathState::CONNECTING && path.state != IEC104PathState::CONNECTED)
+        return;
+
+    m_scheduler.cancel(path.timer);
+
+    // A fresh connection is used for the next attempt, the old one is destroyed out of the lock
+    CS104_Connection new_connection = m_createConnection(path_index);
+    {
+        lock_guard<mutex> lock(m_paths_mutex);
+        path.started = false;
+        path.connection = new_connection;
+        path.state = IEC104PathState::BACKOFF;
+    }
+    CS104_Connection_destroy(connection);
+
+    uint64_t delay_ms = m_getBackoffDelay(path.failures++);
+    Logger::getLogger()->warn("Path " + to_string(path_index) + " : " + reason + ", reconnecting in "
+                              + to_string(delay_ms) + " ms");
+
+    path.timer = m_scheduler.schedule(delay_ms, [this, path_index]() { m_connectPath(path_index); });
+
+    if (path_index == m_active_path)
+    {
+        // Failover : a connected standby path gets STARTDT right away, no other path is restarted
+        m_failover_start_ms = IEC104Scheduler::nowMs();
+        m_failovers++;
+
+        m_requeueCommandsInFlight();
+        m_electActivePath();
+        m_pumpCommands();
+    }
+}
+
+
+/**
+ * Commands waiting for an answer from the lost active path are sent again first,
+ * through the path elected next, rather than after their timeout.
+ */
+void IEC104::m_requeueCommandsInFlight()
+{
+    for (auto& entry : m_commands_in_flight)
+    {
+        IEC104Command& command = entry.second;
+        m_scheduler.cancel(command.timer);
+
+        // The attempt lost with the path does not count
+        command.attempts = max(0, command.attempts - 1);
+        m_command_queue.push_front(command);
+    }
+    m_commands_in_flight.clear();
+}
+
+
+/** Scheduler task : ingest the statistics Reading, on each stats_period and on the latency_stats operation */
+void IEC104::m_sendStatistics()
+{
+    Reading* reading = m_createStatisticsReading();
+
+    // Not through ingest(), not to end the measure of a failover, but with the same ownership : the vector stays ours
+    if (m_ingest_v2 != nullptr)
+    {
+        vector<Reading*> readings{reading};
+        (*m_ingest_v2)(m_data, &readings);
+    }
+    else
+    {
+        (*m_ingest)(m_data, *reading);
+        delete reading;
+    }
+}
+
+
+template <class T>
+static Datapoint* createStatisticsDatapoint(const string& name, T value)
+{
+    DatapointValue dp_value(value);
+    return new Datapoint(name, dp_value);
+}
+
+static Datapoint* createStatisticsDatapoint(const string& name, vector<Datapoint*>* values)
+{
+    DatapointValue dp_value(values, true);
+    return new Datapoint(name, dp_value);
+}
+
+
+/**
+ * Statistics Reading, asset "<asset>_stats" :
+ *   {"<stage>" : {"count", "p50_us", "p99_us", "p999_us", "max_us"}, ...,
+ *    "by_type" : {"<TypeID>" : {"<stage>" : {...}, ...}, ...},
+ *    "failover" : {"count", "last_ms", "max_ms"}}
+ * Stages without any value are left out : all of them unless latency_stats is set.
+ */
+Reading* IEC104::m_createStatisticsReading()
+{
+    auto stagesDatapoints = [](const IEC104LatencyStats::Stages& stages)
+    {
+        auto* datapoints = new vector<Datapoint*>;
+        for (int stage = 0; stage < IEC104LatencyStats::STAGES; stage++)
+        {
+            const IEC104Histogram& histogram = stages.stage[stage];
+            if (histogram.count() == 0)
+                continue;
+
+            auto* values = new vector<Datapoint*>;
+            values->push_back(createStatisticsDatapoint("count", (long) histogram.count()));
+            values->push_back(createStatisticsDatapoint("p50_us", histogram.percentile(50) / 1000.0));
+            values->push_back(createStatisticsDatapoint("p99_us", histogram.percentile(99) / 1000.0));
+            values->push_back(createStatisticsDatapoint("p999_us", histogram.percentile(99.9) / 1000.0));
+            values->push_back(createStatisticsDatapoint("max_us", histogram.max() / 1000.0));
+            datapoints->push_back(createStatisticsDatapoint(IEC104LatencyStats::getStageName(stage), values));
+        }
+        return datapoints;
+    };
+
+    const IEC104LatencyStats& latency = m_client->latency();
+    vector<Datapoint*>* datapoints = stagesDatapoints(latency.all());
+
+    auto* by_type = new vector<Datapoint*>;
+    for (int type_id = 0; type_id < 256; type_id++)
+    {
+        const IEC104LatencyStats::Stages* stages = latency.byType(type_id);
+        if (stages != nullptr)
+            by_type->push_back(createStatisticsDatapoint(TypeID_toString((TypeID) type_id), stagesDatapoints(*stages)));
+    }
+    datapoints->push_back(createStatisticsDatapoint("by_type", by_type));
+
+    auto* failover = new vector<Datapoint*>;
+    failover->push_back(createStatisticsDatapoint("count", (long) m_failovers.load()));
+    failover->push_back(createStatisticsDatapoint("last_ms", (long) m_last_failover_latency_ms.load()));
+    failover->push_back(createStatisticsDatapoint("max_ms", (long) m_max_failover_latency_ms.load()));
+    datapoints->push_back(createStatisticsDatapoint("failover", failover));
+
+    auto* reading = new Reading(m_asset + "_stats", *datapoints);
+    delete datapoints;
+    return reading;
+}
+
+
+/**
+ * Called for every ingest, by the ingest worker thread. Readings of ASDUs received
+ * before the failover are the backlog of the lost path : they don't end it.
+ *
+ * @param received_ns   IEC104LatencyStats::nowNs() when the newest ASDU was received, 0 if unknown
+ */
+void IEC104::m_onIngest(uint64_t received_ns)
+{
+    uint64_t failover_start_ms = m_failover_start_ms.load(memory_order_relaxed);
+    if (failover_start_ms == 0 || received_ns / 1000000 <= failover_start_ms
+        || !m_failover_start_ms.compare_exchange_strong(failover_start_ms, 0))
+        return;
+
+    uint64_t latency_ms = IEC104Scheduler::nowMs() - failover_start_ms;
+    m_last_failover_latency_ms = latency_ms;
+    if (latency_ms > m_max_failover_latency_ms)
+        m_max_failover_latency_ms = latency_ms;
+
+    Logger::getLogger()->info("Failover completed, first reading ingested " + to_string(latency_ms)
+                              + " ms after the loss of the active path");
+}
+
+
+/**
+ * Exponential backoff from reconnect_delay_min to reconnect_delay_max, with equal
+ * jitter so that plugins losing the same RTU do not reconnect in step
+ */
+uint64_t IEC104::m_getBackoffDelay(unsigned int failures)
+{
+    const IEC104TransportConfig& transport = m_active_config->transport;
+
+    uint64_t delay_ms = (uint64_t) transport.reconnect_delay_min << min(failures, 20u);
+    delay_ms = min(delay_ms, (uint64_t) transport.reconnect_delay_max);
+
+    return delay_ms / 2 + uniform_int_distribution<uint64_t>(0, delay_ms / 2)(m_random);
+}
+
+
+void IEC104::m_setPathState(IEC104Path& path, IEC104PathState state)
+{
+    lock_guard<mutex> lock(m_paths_mutex);
+    path.state = state;
+}
+
+
+int IEC104::m_getPathIndex(CS104_Connection connection) const
+{
+    for (unsigned int i = 0; i < m_paths.size(); i++)
+        if (m_paths[i].connection == connection)
+            return (int) i;
+    return -1;
+}
+
+
+/** Time from start() to each startup phase of the paths, and to the end of the first GI round */
+void IEC104::m_logStartupTimings()
+{
+    auto since_start = [this](uint64_t ms) { return ms != 0 ? to_string(ms - m_start_time_ms) + " ms" : string("-"); };
+
+    string timings = "Startup timings :";
+    for (unsigned int i = 0; i < m_paths.size(); i++)
+    {
+        const IEC104Path& path = m_paths[i];
+        timings += " path " + to_string(i) + " [connect " + since_start(path.connected_ms)
+                 + ", STARTDT_CON " + since_start(path.startdt_con_ms) + "]";
+    }
+    timings += ", GI complete " + since_start(m_gi_complete_ms);
+
+    Logger::getLogger()->info(timings);
+}
+
+
+/** Scheduler task, also run when the startup_time watchdog expires */
+void IEC104::m_checkStartup()
+{
+    if (m_startup_done)
+        return;
+
+    double elapsed = (double) (IEC104Scheduler::nowMs() - m_start_time_ms) / 1000;
+
+    bool all_connected = all_of(m_paths.begin(), m_paths.end(),
+                                [](const IEC104Path& path) { return path.state == IEC104PathState::CONNECTED; });
+    if (all_connected)
+    {
+        m_startup_done = true;
+        Logger::getLogger()->info("Startup completed in " + to_string(elapsed) + " seconds.");
+    }
+    else if (elapsed >= m_active_config->application.startup_time)
+        Logger::getLogger()->warn("Startup is taking too long, " + to_string(elapsed) + " seconds so far");
+}
+
+
+CS104_Connection IEC104::m_createConnection(unsigned int path_index)
+{
+    const IEC104PathConfig& path = m_active_config->transport.paths[path_index];
+    CS104_Connection new_connection;
+
+    try {
+        if (m_active_config->transport.tls)
+            new_connection = m_createTlsConnection(path.srv_ip.c_str(), path.port);
+        else
+            new_connection = CS104_Connection_create(path.srv_ip.c_str(), path.port);
+        Logger::getLogger()->info("Connection created");
+    }
+    catch (exception &e) { Logger::getLogger()->error("Exception while creating connection", e.what()); throw e; }
+    CS104_Connection_setConnectionHandler(new_connection, m_connectionHandler, static_cast<void *>(this));
+    CS104_Connection_setASDUReceivedHandler(new_connection, m_asduReceivedHandler, static_cast<void *>(m_client));
+    if (m_capture)
+        CS104_Connection_setRawMessageHandler(new_connection, IEC104Capture::rawMessageHandler, m_capture->getSource(path_index));
+    m_configureConnection(new_connection);
+
+    return new_connection;
+}
+
+
+void IEC104::start()
+{
+    Logger::getLogger()->info("Starting iec104");
+
+    m_active_config = atomic_load(&m_config);
+    if (!m_active_config)
+    {
+        Logger::getLogger()->error("No valid configuration, iec104 not started");
+        return;
+    }
+    const IEC104Config& config = *m_active_config;
+
+    //Fledge logging level setting
+	switch (config.transport.llevel)
+	{
+		case 1:
+            Logger::getLogger()->setMinLevel("debug");
+			break;
+		case 2:
+            Logger::getLogger()->setMinLevel("info");
+			break;
+		case 3:
+            Logger::getLogger()->setMinLevel("warning");
+			break;
+		default:
+			Logger::getLogger()->setMinLevel("error");
+			break;
+	}
+
+    m_client = new IEC104Client(this, m_active_config);
+    m_client->startWorker();
+
+    {
+        lock_guard<mutex> lock(m_paths_mutex);
+
+        // The raw message handler of each connection appends to the capture, while it is enabled
+        if (!config.transport.capture_file.empty())
+        {
+            m_capture.reset(new IEC104Capture());
+            if (m_capture->open(config.transport.capture_file, (size_t) config.transport.capture_size << 20,
+                                config.transport.paths.size()))
+                m_capture->setEnabled(config.transport.capture_enabled);
+            else
+                m_capture.reset();
+        }
+
+        if (config.transport.tls)
+            m_tls_config = m_createTlsConfiguration();
+
+        for (unsigned int i = 0; i < config.transport.paths.size(); i++)
+        {
+            IEC104Path path;
+            path.connection = m_createConnection(i);
+            m_paths.push_back(path);
+
+            // If conn_all == false, only use the first path
+            if (!config.transport.conn_all)
+            {
+                break;
+            }
+        }
+    }
+
+    // Everything else runs on the scheduler thread : start() returns immediately
+    m_startup_done = false;
+    m_gi_in_progress = false;
+    m_command_queue.clear();
+    m_commands_in_flight.clear();
+    m_broadcast_pending.clear();
+    m_pump_timer = 0;
+    m_next_command_ms = 0;
+    m_gi_complete_ms = 0;
+    m_active_path = -1;
+    m_failover_start_ms = 0;
+    m_start_time_ms = IEC104Scheduler::nowMs();
+    m_scheduler.start();
+
+    if (config.application.startup_state || config.transport.conn_passv)
+    {
+        for (unsigned int i = 0; i < m_paths.size(); i++)
+            m_scheduler.schedule(0, [this, i]() { m_connectPath(i); });
+
+        m_scheduler.schedule(1000 * (uint64_t) config.application.startup_time, [this]() { m_checkStartup(); });
+    }
+
+	// Test commands are sent at same rate as gi, every second if gi is not activated or gi_time is 0
+	if (config.application.exec_cycl_test)
+	{
+	    uint64_t test_period = config.application.gi_cycle ? max<uint64_t>(1000, 1000 * (uint64_t) config.application.gi_time) : 1000;
+	    m_scheduler.scheduleEvery(test_period, test_period, [this]() { m_sendTestCommmands(); });
+	}
+
+	if (config.application.stats_period > 0)
+	{
+	    uint64_t stats_period_ms = 1000 * (uint64_t) config.application.stats_period;
+	    m_scheduler.scheduleEvery(stats_period_ms, stats_period_ms, [this]() { m_sendStatistics(); });
+	}
+
+	for (auto& group : config.application.gi_groups)
+	{
+	    uint64_t period_ms = 1000 * (uint64_t) group.period;
+	    unsigned int ca = group.ca;
+	    int group_number = group.group;
+	    m_scheduler.scheduleEvery(period_ms, period_ms, [this, ca, group_number]() { m_sendGroupInterrogation(ca, group_number); });
+	}
+}
+
+
+/** Disconnect from the iec104 servers */
+void IEC104::stop()
+{
+    // No timed task runs past this point, and closed connections are not reconnected anymore
+    m_scheduler.stop();
+
+    // Like the receive threads, a replay pushes to the ingest queue
+    m_replay_stop = true;
+    if (m_replay_thread.joinable())
+        m_replay_thread.join();
+    m_replay_stop = false;
+
+    // Receive threads are stopped first, so nothing is pushed to the ingest queue while it is drained
+    vector<IEC104Path> paths;
+    {
+        lock_guard<mutex> lock(m_paths_mutex);
+        paths.swap(m_paths);
+    }
+    for (auto& path : paths)
+    {
+        CS104_Connection_destroy(path.connection);
+        Logger::getLogger()->info("Connection stopped");
+    }
+
+    if (m_tls_config != nullptr)
+    {
+        TLSConfiguration_destroy(m_tls_config);
+        m_tls_config = nullptr;
+    }
+
+    // No raw message handler is called anymore
+    {
+        lock_guard<mutex> lock(m_paths_mutex);
+        if (m_capture)
+            Logger::getLogger()->info("Captured " + to_string(m_capture->capturedBytes()) + " bytes of APDUs");
+        m_capture.reset();
+    }
+
+    if (m_client != nullptr)
+    {
+        m_client->stopWorker();
+
+        Logger::getLogger()->info("Decoded " + to_string(m_client->decodedElements()) + " information objects, "
+                                  + to_string(m_client->heapDecodedElements()) + " of them with a heap allocation");
+        Logger::getLogger()->info("Ingest queue high water mark " + to_string(m_client->queueHighWaterMark()) + "/"
+                                  + to_string(m_client->queueCapacity()) + ", "
+                                  + to_string(m_client->queueFullWaits()) + " waits on a full queue");
+        Logger::getLogger()->info("Forwarded " + to_string(m_client->forwardedValues()) + " values, suppressed "
+                                  + to_string(m_client->suppressedValues()) + " by deadbands and "
+                                  + to_string(m_client->suppressedUnchangedValues()) + " unchanged ones");
+        Logger::getLogger()->info(to_string(m_failovers) + " failover(s) of the active path, last one in "
+                                  + to_string(m_last_failover_latency_ms) + " ms, longest one in "
+                                  + to_string(m_max_failover_latency_ms) + " ms");
+    }
+
+    delete m_client;
+    m_client = nullptr;
+}
+
+
+/**
+ * Parse the I format APDUs received in a capture file, and hand their ASDU to
+ * m_asduReceivedHandler as a receive thread would. Runs on the calling thread.
+ *
+ * The live state is left alone : the ASDUs go through a client of their own, with
+ * its own deadband and unchanged value filter, and the command responses (C_IC_NA_1,
+ * C_TS_*...) are skipped, so that they do not complete the commands in flight.
+ */
+uint64_t IEC104::replay(const string& capture_file, double speed)
+{
+    if (m_client == nullptr)
+    {
+        Logger::getLogger()->error("iec104 not started, %s not replayed", capture_file.c_str());
+        return 0;
+    }
+
+    IEC104CaptureReader reader;
+    if (!reader.open(capture_file))
+        return 0;
+
+    static const DecodeFunction* decoders = m_getDecoders();
+
+    // The capture must have been made with the same CA and IOA sizes
+    sCS101_AppLayerParameters app_layer_parameters = m_getAppLayerParameters();
+
+    IEC104Client client(this, m_active_config);
+    client.startWorker();
+
+    const IEC104CaptureRecord* record;
+    const uint8_t* apdu;
+    uint64_t asdus = 0;
+    uint64_t first_ns = 0;
+    auto start = chrono::steady_clock::now();
+
+    while (!m_replay_stop && reader.next(record, apdu))
+    {
+        // Start byte, length and 4 control field octets, the first one with bit 0 clear for the I format
+        const int APCI_SIZE = 6;
+        if (record->direction != IEC104CaptureRecord::RECEIVED || record->length <= APCI_SIZE
+            || apdu[0] != 0x68 || (apdu[2] & 0x01) != 0)
+            continue;
+
+        if (speed > 0)
+        {
+            if (first_ns == 0)
+                first_ns = record->timestamp_ns;
+
+            // Sleep in short steps, so that stop() does not wait for a long silence of the capture
+            auto due = start + chrono::nanoseconds((uint64_t) ((record->timestamp_ns - first_ns) / speed));
+            while (!m_replay_stop && chrono::steady_clock::now() < due)
+                this_thread::sleep_until(min(due, chrono::steady_clock::now() + chrono::milliseconds(100)));
+        }
+
+        // The ASDU only refers to the mapped APDU, which it does not modify
+        CS101_ASDU asdu = CS101_ASDU_createFromBuffer(&app_layer_parameters, const_cast<uint8_t*>(apdu) + APCI_SIZE,
+                                                      record->length - APCI_SIZE);
+        if (asdu == nullptr)
+            continue;
+
+        if (decoders[CS101_ASDU_getTypeID(asdu) & 0xff] != nullptr)
+        {
+            m_asduReceivedHandler(&client, 0, asdu);
+            asdus++;
+        }
+        CS101_ASDU_destroy(asdu);
+    }
+
+    // The readings of the last ASDUs are ingested before returning
+    client.stopWorker();
+    return asdus;
+}
+
+
+/**
+ * Called when a data changed event is received. This calls back to the south service
+ * and adds the points to the readings queue to send.
+ *
+ * @param points    The points in the reading we must create
+ */
+void IEC104::ingest(Reading& reading)
+{
+    m_onIngest(0);
+    (*m_ingest)(m_data, reading);
+}
+
+
+/**
+ * Send a batch of readings to the south service in a single call when it supports
+ * multi-reading ingest, one reading at a time otherwise.
+ * The readings are owned by the service (or freed here) once this returns.
+ *
+ * @param readings      The readings to ingest, the vector is deleted by this call
+ * @param received_ns   IEC104LatencyStats::nowNs() when the newest ASDU of the readings was received
+ */
+void IEC104::ingest(vector<Reading *>* readings, uint64_t received_ns)
+{
+    m_onIngest(received_ns);
+
+    if (m_ingest_v2 != nullptr)
+    {
+        (*m_ingest_v2)(m_data, readings);
+    }
+    else
+    {
+        for (Reading* reading : *readings)
+        {
+            (*m_ingest)(m_data, *reading);
+            delete reading;
+        }
+    }
+
+    delete readings;
+}
+
+
+/**
+ * Save the callback function and its data
+ * @param data   The Ingest function data
+ * @param cb     The callback function to call
+ */
+void IEC104::registerIngest(void *data, INGEST_CB cb)
+{
+    m_ingest = cb;
+    m_ingest_v2 = nullptr;
+    m_data = data;
+}
+
+
+/**
+ * Save the multi-reading callback function and its data
+ * @param data   The Ingest function data
+ * @param cb     The callback function to call with a batch of readings
+ */
+void IEC104::registerIngestV2(void *data, INGEST_CB2 cb)
+{
+    m_ingest_v2 = cb;
+    m_ingest = nullptr;
+    m_data = data;
+}
+
+
+// ==================================================================== //
+// Command planner : interrogations and test commands are queued, and sent
+// one CA at a time, paced, while the ingest queue keeps up. A CA has at
+// most one command waiting for its answer.
+
+/** Scheduler task : start a station GI round, unless one is in progress */
+void IEC104::m_sendInterrogationCommmands()
+{
+    const IEC104Config& config = *m_active_config;
+
+    if (m_gi_in_progress)
+        return;
+
+    m_gi_in_progress = true;
+    m_gi_round_start_ms = IEC104Scheduler::nowMs();
+    m_gi_round_pending = 0;
+    m_gi_round_done = 0;
+    m_gi_round_failed = 0;
+
+    // If we try to send to every ca
+    if (config.application.gi_all_ca)
+    {
+        for (unsigned int ca : config.cas)
+            m_queueCommand(IEC104Command::INTERROGATION, ca, IEC60870_QOI_STATION);
+    }
+    else  // Otherwise, one broadcast GI, each CA answering with its own address
+        m_queueCommand(IEC104Command::INTERROGATION, config.getBroadcastCA(), IEC60870_QOI_STATION);
+
+    m_pumpCommands();
+}
+
+
+/** Scheduler task : group interrogation of gi_groups */
+void IEC104::m_sendGroupInterrogation(unsigned int ca, int group)
+{
+    m_queueCommand(IEC104Command::INTERROGATION, ca, IEC60870_QOI_STATION + group);
+    m_pumpCommands();
+}
+
+
+/** Scheduler task : test command to every CA */
+void IEC104::m_sendTestCommmands()
+{
+    for (unsigned int ca : m_active_config->cas)
+        m_queueCommand(IEC104Command::TEST, ca, 0);
+    m_pumpCommands();
+}
+
+
+/** Queue a command, unless the same one is already queued */
+void IEC104::m_queueCommand(IEC104Command::Kind kind, unsigned int ca, int qoi)
+{
+    for (auto& command : m_command_queue)
+        if (command.kind == kind && command.ca == ca && command.qoi == qoi)
+            return;
+
+    IEC104Command command;
+    command.kind = kind;
+    command.ca = ca;
+    command.qoi = qoi;
+    m_command_queue.push_back(command);
+
+    if (m_isRoundCommand(command))
+        m_gi_round_pending += m_isBroadcast(command) ? m_active_config->cas.size() : 1;
+}
+
+
+/**
+ * Send the next queued command whose CA has no command in flight. Commands are
+ * at least gi_pacing ms apart, and wait while the ingest queue is more than half
+ * full, so that the answers of many CAs do not arrive in one burst.
+ */
+void IEC104::m_pumpCommands()
+{
+    const IEC104Config& config = *m_active_config;
+    uint64_t now = IEC104Scheduler::nowMs();
+
+    if (m_pump_timer != 0)
+        return;
+
+    bool backlog = m_client->queueDepth() > m_client->queueCapacity() / 2;
+    if (now < m_next_command_ms || backlog)
+    {
+        uint64_t delay_ms = max<uint64_t>(m_next_command_ms > now ? m_next_command_ms - now : 0,
+                                          backlog ? max(config.application.gi_pacing, 10) : 0);
+        m_pump_timer = m_scheduler.schedule(delay_ms, [this]() { m_pump_timer = 0; m_pumpCommands(); });
+        return;
+    }
+
+    size_t in_flight_gis = count_if(m_commands_in_flight.begin(), m_commands_in_flight.end(),
+        [](const pair<const unsigned int, IEC104Command>& entry) { return entry.second.kind == IEC104Command::INTERROGATION; });
+
+    for (auto it = m_command_queue.begin(); it != m_command_queue.end(); ++it)
+    {
+        if (m_commands_in_flight.count(it->ca) != 0)
+            continue;
+        if (it->kind == IEC104Command::INTERROGATION && in_flight_gis >= (size_t) config.application.gi_max_concurrent)
+            continue;
+
+        IEC104Command& command = m_commands_in_flight[it->ca];
+        command = *it;
+        m_command_queue.erase(it);
+
+        m_sendCommand(command);
+        m_next_command_ms = now + config.application.gi_pacing;
+
+        // Come back for the next one once the pacing delay is over
+        if (!m_command_queue.empty())
+            m_pump_timer = m_scheduler.schedule(config.application.gi_pacing, [this]() { m_pump_timer = 0; m_pumpCommands(); });
+        return;
+    }
+}
+
+
+/**
+ * Send (or send again) a command. An interrogation has gi_time to terminate, a test
+ * command t1_timeout to be confirmed, a command that could not be sent is retried
+ * after a second.
+ */
+void IEC104::m_sendCommand(IEC104Command& command)
+{
+    const IEC104Config& config = *m_active_config;
+    unsigned int ca = command.ca;
+
+    command.attempts++;
+    command.confirmed = false;
+    command.sequence = ++m_command_sequence;
+
+    if (m_isBroadcast(command) && m_broadcast_pending.empty())
+        m_broadcast_pending.insert(config.cas.begin(), config.cas.end());
+
+    bool sent = command.kind == IEC104Command::INTERROGATION ? m_sendInterrogationCommmandToCA(ca, command.qoi)
+                                                             : m_sendTestCommandToCA(ca);
+
+    uint64_t timeout_ms = 1000;
+    if (sent)
+    {
+        command.sent_ms = IEC104Scheduler::nowMs();
+        timeout_ms = 1000 * (uint64_t) (command.kind == IEC104Command::INTERROGATION ? max(1, config.application.gi_time)
+                                                                                     : config.transport.t1_timeout);
+    }
+
+    uint64_t sequence = command.sequence;
+    command.timer = m_scheduler.schedule(timeout_ms, [this, ca, sequence]() { m_onCommandTimeout(ca, sequence); });
+}
+
+
+/** Scheduler task : the attempt sequence of the command in flight for ca was not answered in time, or could not be sent */
+void IEC104::m_onCommandTimeout(unsigned int ca, uint64_t sequence)
+{
+    // The timeout of an earlier command to the same CA, which has finished since
+    auto it = m_commands_in_flight.find(ca);
+    if (it == m_commands_in_flight.end() || it->second.sequence != sequence)
+        return;
+
+    IEC104Command& command = it->second;
+    int max_attempts = command.kind == IEC104Command::INTERROGATION ? max(1, m_active_config->application.gi_repeat_count) : 1;
+
+    if (m_isBroadcast(command))
+    {
+        // Only the CAs that did not answer are asked again, one by one
+        Logger::getLogger()->warn("Broadcast interrogation not terminated by " + to_string(m_broadcast_pending.size())
+                                  + " CA(s), interrogating them one at a time");
+        m_finishBroadcast(false);
+        return;
+    }
+
+    if (command.attempts < max_attempts)
+    {
+        Logger::getLogger()->warn("Interrogation of ca = " + to_string(ca) + " (QOI " + to_string(command.qoi)
+                                  + ") not terminated, attempt " + to_string(command.attempts + 1));
+        m_sendCommand(command);
+        return;
+    }
+
+    Logger::getLogger()->warn(string(command.kind == IEC104Command::INTERROGATION ? "Interrogation" : "Test command")
+                              + " of ca = " + to_string(ca) + " failed after " + to_string(command.attempts) + " attempt(s)");
+    m_finishCommand(it, false);
+}
+
+
+/** Scheduler task : ACTCON or ACTTERM of an interrogation or test command received from the outstation */
+void IEC104::m_onCommandResponse(int type_id, unsigned int ca, int qoi, int cot, bool negative)
+{
+    if (type_id == C_IC_NA_1 && qoi == IEC60870_QOI_STATION && (m_broadcast_pending.count(ca) != 0
+                                 || ca == (unsigned int) m_active_config->getBroadcastCA()))
+    {
+        m_onBroadcastResponse(ca, cot, negative);
+        return;
+    }
+
+    auto it = m_commands_in_flight.find(ca);
+    if (it == m_commands_in_flight.end())
+        return;
+
+    IEC104Command& command = it->second;
+    bool is_interrogation = type_id == C_IC_NA_1;
+    if (is_interrogation != (command.kind == IEC104Command::INTERROGATION) || (is_interrogation && qoi != command.qoi))
+        return;
+
+    uint64_t now = IEC104Scheduler::nowMs();
+
+    // A test command is done with its ACTCON, an interrogation with its ACTTERM
+    if (is_interrogation && cot == CS101_COT_ACTIVATION_CON && !negative)
+    {
+        command.confirmed = true;
+        Logger::getLogger()->debug("Interrogation of ca = " + to_string(ca) + " confirmed after "
+                                   + to_string(now - command.sent_ms) + " ms");
+        return;
+    }
+
+    bool success = !negative && cot == (is_interrogation ? CS101_COT_ACTIVATION_TERMINATION : CS101_COT_ACTIVATION_CON);
+    if (success && is_interrogation)
+    {
+        if (command.qoi == IEC60870_QOI_STATION)
+            m_gi_durations[ca] = now - command.sent_ms;
+        Logger::getLogger()->info("Interrogation of ca = " + to_string(ca) + " (QOI " + to_string(command.qoi)
+                                  + ") completed in " + to_string(now - command.sent_ms) + " ms");
+    }
+    else if (!success)
+    {
+        // Negative confirmation : the outstation refuses the command, asking again would not help
+        Logger::getLogger()->warn(string(is_interrogation ? "Interrogation" : "Test command") + " of ca = "
+                                  + to_string(ca) + " rejected by the outstation (COT " + to_string(cot)
+                                  + (negative ? ", negative)" : ")"));
+    }
+
+    m_finishCommand(it, success);
+}
+
+
+/**
+ * ACTCON or ACTTERM of the broadcast GI in flight. Outstations answer it with the address of
+ * each of their CAs, some with the broadcast address itself, which then stands for all of them.
+ */
+void IEC104::m_onBroadcastResponse(unsigned int ca, int cot, bool negative)
+{
+    auto it = m_commands_in_flight.find(m_active_config->getBroadcastCA());
+    if (it == m_commands_in_flight.end())
+        return;
+
+    IEC104Command& command = it->second;
+    uint64_t now = IEC104Scheduler::nowMs();
+    bool all = ca == (unsigned int) m_active_config->getBroadcastCA();
+
+    if (cot == CS101_COT_ACTIVATION_CON && !negative)
+    {
+        command.confirmed = true;
+        return;
+    }
 
-    try
-    { m_tls_configuration = json::parse(tls_configuration)["tls_conf"]; }
-    catch (json::parse_error& e)
-    { Logger::getLogger()->fatal("Couldn't read tls_conf json config string : " + string(e.what())); }
-}
+    bool success = !negative && cot == CS101_COT_ACTIVATION_TERMINATION;
+    if (!success)
+        Logger::getLogger()->warn("Broadcast interrogation rejected by ca = " + to_string(ca) + " (COT " + to_string(cot)
+                                  + (negative ? ", negative)" : ")"));
 
+    if (all)
+    {
+        if (success)
+            for (unsigned int pending_ca : m_broadcast_pending)
+                m_gi_durations[pending_ca] = now - command.sent_ms;
+        m_finishBroadcast(success);
+        return;
+    }
 
-void IEC104::m_connectionHandler (void* parameter, CS104_Connection connection, CS104_ConnectionEvent event)
-{
-    if (event == CS104_CONNECTION_CLOSED)
+    m_broadcast_pending.erase(ca);
+    if (m_gi_in_progress && m_gi_round_pending > 0)
     {
-        Logger::getLogger()->warn("CONNECTION LOST... Reconnecting");
-        auto iec104 = (IEC104*)parameter;
+        m_gi_round_pending--;
+        (success ? m_gi_round_done : m_gi_round_failed)++;
+    }
+    if (success)
+        m_gi_durations[ca] = now - command.sent_ms;
 
-        auto connection_it = find(iec104->m_connections.begin(), iec104->m_connections.end(), connection);
-        *connection_it = nullptr;
-        iec104->restart();
+    if (m_broadcast_pending.empty())
+    {
+        Logger::getLogger()->info("Broadcast interrogation completed in " + to_string(now - command.sent_ms) + " ms");
+        m_finishBroadcast(true);
     }
 }
 
 
-/** Handle ASDU message
- *  For CS104 the address parameter has to be ignored
+/**
+ * End the broadcast GI in flight. CAs that did not terminate it are counted as done
+ * when success is set, and are otherwise queued for a GI of their own.
  */
-bool IEC104::m_asduReceivedHandler(void *parameter, int address, CS101_ASDU asdu) {
-    vector<Datapoint *> datapoints;
-    auto mclient = static_cast<IEC104Client *>(parameter);
+void IEC104::m_finishBroadcast(bool success)
+{
+    auto it = m_commands_in_flight.find(m_active_config->getBroadcastCA());
+    if (it == m_commands_in_flight.end())
+        return;
 
-    unsigned int ca = CS101_ASDU_getCA(asdu);
-    std::string label;
-    switch (CS101_ASDU_getTypeID(asdu)) {
-        case M_ME_NB_1:
-            Logger::getLogger()->debug("Received M_ME_NB_1");
-            for (int i = 0; i < CS101_ASDU_getNumberOfElements(asdu); i++) {
-                InformationObject io = CS101_ASDU_getElement(asdu, i);
-                long ioa = InformationObject_getObjectAddress(io);
-                if (!(label = IEC104::m_checkExchangedDataLayer(ca, "M_ME_NB_1", ioa)).empty()) {
-                    auto io_casted = (MeasuredValueScaled) io;
-                    long int value = MeasuredValueScaled_getValue((MeasuredValueScaled) io_casted);
-                    QualityDescriptor qd = MeasuredValueScaled_getQuality(io_casted);
-                    mclient->addData(datapoints, ioa, label, value, qd);
-
-                    MeasuredValueScaled_destroy(io_casted);
-                }
-            }
-            break;
-        case M_SP_NA_1:
-            Logger::getLogger()->debug("Received M_SP_NA_1");
-            for (int i = 0; i < CS101_ASDU_getNumberOfElements(asdu); i++) {
-                InformationObject io = CS101_ASDU_getElement(asdu, i);
-                long ioa = InformationObject_getObjectAddress(io);
-                if (!(label = IEC104::m_checkExchangedDataLayer(ca, "M_SP_NA_1", ioa)).empty()) {
-                    auto io_casted = (SinglePointInformation) io;
-                    long int value = SinglePointInformation_getValue((SinglePointInformation) io_casted);
-                    QualityDescriptor qd = SinglePointInformation_getQuality((SinglePointInformation) io_casted);
-                    mclient->addData(datapoints, ioa, label, value, qd);
-
-                    SinglePointInformation_destroy(io_casted);
-                }
-            }
-            break;
-        case M_SP_TB_1:
-            Logger::getLogger()->debug("Received M_SP_TB_1");
-            for (int i = 0; i < CS101_ASDU_getNumberOfElements(asdu); i++) {
-                InformationObject io = CS101_ASDU_getElement(asdu, i);
-                long ioa = InformationObject_getObjectAddress(io);
-                if (!(label = IEC104::m_checkExchangedDataLayer(ca, "M_SP_TB_1", ioa)).empty()) {
-                    auto io_casted = (SinglePointWithCP56Time2a) io;
-                    long int value = SinglePointInformation_getValue((SinglePointInformation) io_casted);
-                    QualityDescriptor qd = SinglePointInformation_getQuality((SinglePointInformation) io_casted);
-                    if (m_comm_wttag) {
-                        CP56Time2a ts = SinglePointWithCP56Time2a_getTimestamp(io_casted);
-                        bool is_invalid = CP56Time2a_isInvalid(ts);
-                        if (m_tsiv == "PROCESS" || !is_invalid)
-                            mclient->addData(datapoints, ioa, label, value, qd, ts);
-                    } else
-                        mclient->addData(datapoints, ioa, label, value, qd);
-
-                    SinglePointWithCP56Time2a_destroy(io_casted);
-                }
-            }
-            break;
-        case M_DP_NA_1:
-            Logger::getLogger()->debug("Received M_DP_NA_1");
-            for (int i = 0; i < CS101_ASDU_getNumberOfElements(asdu); i++) {
-                InformationObject io = CS101_ASDU_getElement(asdu, i);
-                long ioa = InformationObject_getObjectAddress(io);
-                if (!(label = IEC104::m_checkExchangedDataLayer(ca, "M_DP_NA_1", ioa)).empty()) {
-                    auto io_casted = (DoublePointInformation) io;
-                    long int value = DoublePointInformation_getValue((DoublePointInformation) io_casted);
-                    QualityDescriptor qd = DoublePointInformation_getQuality((DoublePointInformation) io_casted);
-                    mclient->addData(datapoints, ioa, label, value, qd);
-
-                    DoublePointInformation_destroy(io_casted);
-                }
-            }
-            break;
-        case M_DP_TB_1:
-            Logger::getLogger()->debug("Received M_DP_TB_1");
-            for (int i = 0; i < CS101_ASDU_getNumberOfElements(asdu); i++) {
-                InformationObject io = CS101_ASDU_getElement(asdu, i);
-                long ioa = InformationObject_getObjectAddress(io);
-                if (!(label = IEC104::m_checkExchangedDataLayer(ca, "M_DP_TB_1", ioa)).empty()) {
-                    auto io_casted = (DoublePointWithCP56Time2a) io;
-                    long int value = DoublePointInformation_getValue((DoublePointInformation) io_casted);
-                    QualityDescriptor qd = DoublePointInformation_getQuality((DoublePointInformation) io_casted);
-                    if (m_comm_wttag) {
-                        CP56Time2a ts = DoublePointWithCP56Time2a_getTimestamp(io_casted);
-                        bool is_invalid = CP56Time2a_isInvalid(ts);
-                        if (m_tsiv == "PROCESS" || !is_invalid)
-                            mclient->addData(datapoints, ioa, label, value, qd, ts);
-                    } else
-                        mclient->addData(datapoints, ioa, label, value, qd);
-
-                    DoublePointWithCP56Time2a_destroy(io_casted);
-                }
-            }
-            break;
-        case M_ST_NA_1:
-            Logger::getLogger()->debug("Received M_ST_NA_1");
-            for (int i = 0; i < CS101_ASDU_getNumberOfElements(asdu); i++) {
-                InformationObject io = CS101_ASDU_getElement(asdu, i);
-                long ioa = InformationObject_getObjectAddress(io);
-                if (!(label = IEC104::m_checkExchangedDataLayer(ca, "M_ST_NA_1", ioa)).empty()) {
-                    auto io_casted = (StepPositionInformation) io;
-                    long int value = StepPositionInformation_getValue((StepPositionInformation) io_casted);
-                    QualityDescriptor qd = StepPositionInformation_getQuality((StepPositionInformation) io_casted);
-                    mclient->addData(datapoints, ioa, label, value, qd);
-
-                    StepPositionInformation_destroy(io_casted);
-                }
-            }
-            break;
-        case M_ST_TB_1:
-            Logger::getLogger()->debug("Received M_ST_TB_1");
-            for (int i = 0; i < CS101_ASDU_getNumberOfElements(asdu); i++) {
-                InformationObject io = CS101_ASDU_getElement(asdu, i);
-                long ioa = InformationObject_getObjectAddress(io);
-                if (!(label = IEC104::m_checkExchangedDataLayer(ca, "M_ME_NB_1", ioa)).empty()) {
-                    auto io_casted = (StepPositionWithCP56Time2a) io;
-                    long int value = StepPositionInformation_getValue((StepPositionInformation) io_casted);
-                    QualityDescriptor qd = StepPositionInformation_getQuality((StepPositionInformation) io_casted);
-                    if (m_comm_wttag) {
-                        CP56Time2a ts = StepPositionWithCP56Time2a_getTimestamp(io_casted);
-                        bool is_invalid = CP56Time2a_isInvalid(ts);
-                        if (m_tsiv == "PROCESS" || !is_invalid)
-                            mclient->addData(datapoints, ioa, label, value, qd, ts);
-                    } else
-                        mclient->addData(datapoints, ioa, label, value, qd);
-
-                    StepPositionWithCP56Time2a_destroy(io_casted);
-                }
-            }
-            break;
-        case M_ME_NA_1:
-            Logger::getLogger()->debug("Received M_ME_NA_1");
-            for (int i = 0; i < CS101_ASDU_getNumberOfElements(asdu); i++) {
-                InformationObject io = CS101_ASDU_getElement(asdu, i);
-                long ioa = InformationObject_getObjectAddress(io);
-                if (!(label = IEC104::m_checkExchangedDataLayer(ca, "M_ME_NA_1", ioa)).empty()) {
-                    auto io_casted = (MeasuredValueNormalized) io;
-                    float value = MeasuredValueNormalized_getValue((MeasuredValueNormalized) io_casted);
-                    QualityDescriptor qd = MeasuredValueNormalized_getQuality((MeasuredValueNormalized) io_casted);
-                    mclient->addData(datapoints, ioa, label, value, qd);
-
-                    MeasuredValueNormalized_destroy(io_casted);
-                }
-            }
-            break;
-        case M_ME_TD_1:
-            Logger::getLogger()->debug("Received M_ME_TD_1");
-            for (int i = 0; i < CS101_ASDU_getNumberOfElements(asdu); i++) {
-                InformationObject io = CS101_ASDU_getElement(asdu, i);
-                long ioa = InformationObject_getObjectAddress(io);
-                if (!(label = IEC104::m_checkExchangedDataLayer(ca, "M_ME_TD_1", ioa)).empty()) {
-                    auto io_casted = (MeasuredValueNormalizedWithCP56Time2a) io;
-                    float value = MeasuredValueNormalized_getValue((MeasuredValueNormalized) io_casted);
-                    QualityDescriptor qd = MeasuredValueNormalized_getQuality((MeasuredValueNormalized) io_casted);
-                    if (m_comm_wttag) {
-                        CP56Time2a ts = MeasuredValueNormalizedWithCP56Time2a_getTimestamp(io_casted);
-                        bool is_invalid = CP56Time2a_isInvalid(ts);
-                        if (m_tsiv == "PROCESS" || !is_invalid)
-                            mclient->addData(datapoints, ioa, label, value, qd, ts);
-                    } else
-                        mclient->addData(datapoints, ioa, label, value, qd);
-
-                    MeasuredValueNormalizedWithCP56Time2a_destroy(io_casted);
-                }
-            }
-            break;
-        case M_ME_TE_1:
-            Logger::getLogger()->debug("Received M_ME_TE_1");
-            for (int i = 0; i < CS101_ASDU_getNumberOfElements(asdu); i++) {
-                InformationObject io = CS101_ASDU_getElement(asdu, i);
-                long ioa = InformationObject_getObjectAddress(io);
-                if (!(label = IEC104::m_checkExchangedDataLayer(ca, "M_ME_TE_1", ioa)).empty()) {
-                    auto io_casted = (MeasuredValueScaledWithCP56Time2a) io;
-                    long int value = MeasuredValueScaled_getValue((MeasuredValueScaled) io_casted);
-                    QualityDescriptor qd = MeasuredValueScaled_getQuality((MeasuredValueScaled) io_casted);
-                    if (m_comm_wttag) {
-                        CP56Time2a ts = MeasuredValueScaledWithCP56Time2a_getTimestamp(io_casted);
-                        bool is_invalid = CP56Time2a_isInvalid(ts);
-                        if (m_tsiv == "PROCESS" || !is_invalid)
-                            mclient->addData(datapoints, ioa, label, value, qd, ts);
-                    } else
-                        mclient->addData(datapoints, ioa, label, value, qd);
-
-                    MeasuredValueScaledWithCP56Time2a_destroy(io_casted);
-                }
-            }
-            break;
-        case M_ME_NC_1:
-            Logger::getLogger()->debug("Received M_ME_NC_1");
-            for (int i = 0; i < CS101_ASDU_getNumberOfElements(asdu); i++) {
-                InformationObject io = CS101_ASDU_getElement(asdu, i);
-                long ioa = InformationObject_getObjectAddress(io);
-                if (!(label = IEC104::m_checkExchangedDataLayer(ca, "M_ME_NC_1", ioa)).empty()) {
-                    auto io_casted = (MeasuredValueShort) io;
-                    float value = MeasuredValueShort_getValue((MeasuredValueShort) io_casted);
-                    QualityDescriptor qd = MeasuredValueShort_getQuality((MeasuredValueShort) io_casted);
-                    mclient->addData(datapoints, ioa, label, value, qd);
-
-                    MeasuredValueShort_destroy(io_casted);
-                }
-            }
-            break;
-        case M_ME_TF_1:
-            Logger::getLogger()->debug("Received M_ME_TF_1");
-            for (int i = 0; i < CS101_ASDU_getNumberOfElements(asdu); i++) {
-                InformationObject io = CS101_ASDU_getElement(asdu, i);
-                long ioa = InformationObject_getObjectAddress(io);
-				label = IEC104::m_checkExchangedDataLayer(ca, "M_ME_TF_1", ioa);
-                if (! label.empty()) {
-                    auto io_casted = (MeasuredValueShortWithCP56Time2a) io;
-                    float value = MeasuredValueShort_getValue((MeasuredValueShort) io_casted);
-                    QualityDescriptor qd = MeasuredValueShort_getQuality((MeasuredValueShort) io_casted);
-                    if (m_comm_wttag) {
-                        CP56Time2a ts = MeasuredValueShortWithCP56Time2a_getTimestamp(io_casted);
-                        bool is_invalid = CP56Time2a_isInvalid(ts);
-                        if (m_tsiv == "PROCESS" || !is_invalid)
-                            mclient->addData(datapoints, ioa, label, value, qd, ts);
-                    } else
-                        mclient->addData(datapoints, ioa, label, value, qd);
-
-                    MeasuredValueShortWithCP56Time2a_destroy(io_casted);
-                }
-            }
-            break;
-        case M_EI_NA_1:
-            Logger::getLogger()->info("Received end of initialization");
-            break;
-        case C_IC_NA_1:
-            Logger::getLogger()->info("General interrogation command");
-            break;
-        case C_TS_TA_1:
-            Logger::getLogger()->info("Test command with time tag CP56Time2a");
-            break;
-        case C_SC_TA_1:
-            Logger::getLogger()->info("Single command with time tag CP56Time2a");
-            break;
-        case C_DC_TA_1:
-            Logger::getLogger()->info("Double command with time tag CP56Time2a");
-            break;
-        default:
-            Logger::getLogger()->error("Type of message not supported");
-            return false;
+    m_scheduler.cancel(it->second.timer);
+    m_commands_in_flight.erase(it);
+
+    for (unsigned int ca : m_broadcast_pending)
+    {
+        if (m_gi_in_progress && m_gi_round_pending > 0)
+            m_gi_round_pending--;
+
+        if (success)
+            m_gi_round_done++;
+        else
+            m_queueCommand(IEC104Command::INTERROGATION, ca, IEC60870_QOI_STATION);
     }
-    if (!datapoints.empty())
-        mclient->sendData(asdu, datapoints, label);
+    m_broadcast_pending.clear();
 
-    return true;
+    if (m_gi_in_progress && m_gi_round_pending == 0)
+        m_completeInterrogationRound();
+
+    m_pumpCommands();
 }
 
 
-void IEC104::restart()
+void IEC104::m_finishCommand(unordered_map<unsigned int, IEC104Command>::iterator it, bool success)
 {
-    stop();
-    start();
-}
+    m_scheduler.cancel(it->second.timer);
+
+    if (m_isRoundCommand(it->second))
+    {
+        m_gi_round_pending--;
+        (success ? m_gi_round_done : m_gi_round_failed)++;
+    }
+    m_commands_in_flight.erase(it);
 
+    if (m_gi_in_progress && m_gi_round_pending == 0)
+        m_completeInterrogationRound();
 
-void IEC104::connect(unsigned int connection_index)
-{
-    CS104_Connection connection = m_connections[connection_index];
+    m_pumpCommands();
+}
 
-	//Transport layer initialization
-    sCS104_APCIParameters apci_parameters = {12, 8, 10, 15, 10, 20}; // default values
-    apci_parameters.k = m_getConfigValue<int>(m_stack_configuration, "/transport_layer/k_value"_json_pointer);
-    apci_parameters.w = m_getConfigValue<int>(m_stack_configuration, "/transport_layer/w_value"_json_pointer);
-    apci_parameters.t0 = m_getConfigValue<int>(m_stack_configuration, "/transport_layer/t0_timeout"_json_pointer);
-    apci_parameters.t1 = m_getConfigValue<int>(m_stack_configuration, "/transport_layer/t1_timeout"_json_pointer);
-    apci_parameters.t2 = m_getConfigValue<int>(m_stack_configuration, "/transport_layer/t2_timeout"_json_pointer);
-    apci_parameters.t3 = m_getConfigValue<int>(m_stack_configuration, "/transport_layer/t3_timeout"_json_pointer);
 
-    CS104_Connection_setAPCIParameters(connection, &apci_parameters);
+void IEC104::m_completeInterrogationRound()
+{
+    const IEC104Config& config = *m_active_config;
 
+    m_gi_in_progress = false;
+    Logger::getLogger()->info("Interrogation round complete in " + to_string(IEC104Scheduler::nowMs() - m_gi_round_start_ms)
+                              + " ms : " + to_string(m_gi_round_done) + " CA(s) answered, "
+                              + to_string(m_gi_round_failed) + " failed");
 
-    int asdu_size = m_getConfigValue<int>(m_stack_configuration, "/application_layer/asdu_size"_json_pointer);
+    if (m_gi_round_done > 0 && m_gi_complete_ms == 0)
+    {
+        m_gi_complete_ms = IEC104Scheduler::nowMs();
+        m_logStartupTimings();
+    }
 
-    // If 0 is set in the configuration file, use the maximum value (249 for IEC104)
-    if (asdu_size == 0)
-        asdu_size = 249;
+    if (config.application.gi_cycle)
+    {
+        m_scheduler.cancel(m_gi_cycle_timer);
+        m_gi_cycle_timer = m_scheduler.schedule(1000 * (uint64_t) config.application.gi_time,
+                                                [this]() { m_sendInterrogationCommmands(); });
+    }
+}
 
-	// Application layer initialization
-    sCS101_AppLayerParameters app_layer_parameters = {1,1,
-                                                      2,0,
-                                                      2,3,249}; // default values
-	app_layer_parameters.originatorAddress = m_getConfigValue<int>(m_stack_configuration, "/application_layer/orig_addr"_json_pointer);
-	app_layer_parameters.sizeOfCA = m_getConfigValue<int>(m_stack_configuration, "/application_layer/ca_asdu_size"_json_pointer); // 2
-	app_layer_parameters.sizeOfIOA = m_getConfigValue<int>(m_stack_configuration, "/application_layer/ioaddr_size"_json_pointer); // 3
-    app_layer_parameters.maxSizeOfASDU = asdu_size;
 
-	CS104_Connection_setAppLayerParameters(connection, &app_layer_parameters);
+/** Send an interrogation to ca on the first started path that accepts it */
+bool IEC104::m_sendInterrogationCommmandToCA(unsigned int ca, int qoi)
+{
+    Logger::getLogger()->info("Sending interrogation command to ca = " + to_string(ca) + " (QOI " + to_string(qoi) + ")");
 
-	m_comm_wttag = m_getConfigValue<bool>(m_stack_configuration, "/application_layer/comm_wttag"_json_pointer);
-	m_tsiv = m_getConfigValue<string>(m_stack_configuration, "/application_layer/tsiv"_json_pointer);
+    for (auto& path : m_paths)
+    {
+        if (path.started
+            && CS104_Connection_sendInterrogationCommand(path.connection, CS101_COT_ACTIVATION, ca, (QualifierOfInterrogation) qoi))
+            return true;
+    }
 
-	Logger::getLogger()->info("Connection initialized");
+    return false;
+}
 
-	//Connection
-	if (m_getConfigValue<bool>(m_stack_configuration, "/application_layer/startup_state"_json_pointer)
-	 || m_getConfigValue<bool>(m_stack_configuration, "/transport_layer/conn_passv"_json_pointer))
-	{
-		while (!CS104_Connection_connect(connection)) {}
-		Logger::getLogger()->info("Connection started");
 
-		// If conn_all = false, only start dt with the first connection
-		if (connection_index == 0 || m_getConfigValue<bool>(m_stack_configuration, "/transport_layer/conn_all"_json_pointer))
-		    CS104_Connection_sendStartDT(connection);
+/** Send a test command to ca on the first started path that accepts it */
+bool IEC104::m_sendTestCommandToCA(unsigned int ca)
+{
+    Logger::getLogger()->debug("Sending test command to ca = " + to_string(ca));
 
-		m_sendInterrogationCommmands();
+    for (auto& path : m_paths)
+    {
+        if (!path.started)
+            continue;
 
-        if (m_getConfigValue<bool>(m_stack_configuration, "/application_layer/time_sync"_json_pointer))
+        if (m_active_config->application.comm_wttag)
         {
-            Logger::getLogger()->info("Sending clock sync command");
             sCP56Time2a currentTime{};
             CP56Time2a_createFromMsTimestamp(&currentTime, Hal_getTimeInMs());
-            CS104_Connection_sendClockSyncCommand(connection, m_getBroadcastCA(), &currentTime);
+            if (CS104_Connection_sendTestCommandWithTimestamp(path.connection, ca, m_test_sequence++, &currentTime))
+                return true;
         }
-	}
+        else if (CS104_Connection_sendTestCommand(path.connection, ca))
+            return true;
+    }
+
+    return false;
 }
 
 
-void IEC104::start()
+const IEC104DataPoint* IEC104::m_checkExchangedDataLayer(const IEC104Config& config, unsigned int ca, int type_id, unsigned int ioa)
 {
-    Logger::getLogger()->info("Starting iec104");
+	const IEC104DataPoint* point = config.findPoint(ca, type_id, ioa);
+	if (point != nullptr)
+		return point;
 
-    //Fledge logging level setting
-	switch ( m_getConfigValue<int>(m_stack_configuration, "/transport_layer/llevel"_json_pointer))
-	{
-		case 1:
-            Logger::getLogger()->setMinLevel("debug");
-			break;
-		case 2:
-            Logger::getLogger()->setMinLevel("info");
-			break;
-		case 3:
-            Logger::getLogger()->setMinLevel("warning");
-			break;
-		default:
-			Logger::getLogger()->setMinLevel("error");
-			break;
-	}
+	if (!config.isKnownCA(ca))
+		Logger::getLogger()->warn("Unknown CA (" + to_string(ca) +") for ASDU");
+	else if (!config.isKnownTypeId(ca, type_id))
+		Logger::getLogger()->warn("Unknown type_id (" + string(TypeID_toString((TypeID) type_id)) +") for ASDU");
+	else
+		Logger::getLogger()->warn("Unknown IOA (" + to_string(ioa) +") for ASDU " + TypeID_toString((TypeID) type_id));
 
-    m_startup_done = false;
-	std::thread startupWatchdog(m_watchdog, m_getConfigValue<int>(m_stack_configuration, "/application_layer/startup_time"_json_pointer), 1000, &m_startup_done, "Startup");
+	return nullptr;
+}
 
-    m_client = new IEC104Client(this, &m_pivot_configuration);
 
-    for (auto& path_element : m_stack_configuration["transport_layer"]["connection"]["path"])
-    {
-        CS104_Connection new_connection;
+/** Called by start(), the configuration is used by every connection until stop() */
+TLSConfiguration IEC104::m_createTlsConfiguration() {
+    TLSConfiguration TLSConfig = TLSConfiguration_create(); //TLSConfiguration_create makes plugin unresponsive, without giving any log/exception
+    Logger::getLogger()->debug("Af TLSConf create");
 
-        try {
-            string ip = m_getConfigValue<string>(path_element, "/srv_ip"_json_pointer);
-            int port = m_getConfigValue<int>(path_element, "/port"_json_pointer);
+    const IEC104TlsConfig& tls = m_active_config->tls;
 
-            if (m_getConfigValue<bool>(m_stack_configuration, "/transport_layer/connection/tls"_json_pointer))
-                new_connection = m_createTlsConnection(ip.c_str(),port);
-            else
-                new_connection = CS104_Connection_create(ip.c_str(),port);
-            Logger::getLogger()->info("Connection created");
-        }
-        catch (exception &e) { Logger::getLogger()->error("Exception while creating connection", e.what()); throw e; }
-        CS104_Connection_setConnectionHandler(new_connection, m_connectionHandler, static_cast<void *>(this));
-        CS104_Connection_setASDUReceivedHandler(new_connection, m_asduReceivedHandler, static_cast<void *>(m_client));
+    TLSConfiguration_setOwnCertificateFromFile(TLSConfig, tls.server_cert.c_str());
+    TLSConfiguration_setOwnKeyFromFile(TLSConfig, tls.private_key.c_str(), nullptr);
+    TLSConfiguration_addCACertificateFromFile(TLSConfig, tls.ca_cert.c_str());
 
-        m_connections.push_back(new_connection);
+    return TLSConfig;
+}
 
-        connect(m_connections.size() - 1);
 
-        // If conn_all == false, only use the first path
-        if (!m_getConfigValue<bool>(m_stack_configuration, "/transport_layer/conn_all"_json_pointer))
-		{
-            break;
-		}
-    }
+CS104_Connection IEC104::m_createTlsConnection(const char *ip, int port) {
+    return CS104_Connection_createSecure(ip, port, m_tls_config);
+}
 
-    m_startup_done = true;
 
-    int gi_cycle = m_getConfigValue<int>(m_stack_configuration, "/application_layer/gi_cycle"_json_pointer);
-    int gi_time = m_getConfigValue<int>(m_stack_configuration, "/application_layer/gi_time"_json_pointer);
-	bool exec_cycl_test = m_getConfigValue<bool>(m_stack_configuration, "/application_layer/exec_cycl_test"_json_pointer);
-	// Test commands are sent at same rate as gi, with default of "cycl_test_delay" if gi is not activated
-	while(true)
-    {
-		if (exec_cycl_test)
-			m_sendTestCommmands();
+IEC104Client::IEC104Client(IEC104 *iec104, std::shared_ptr<const IEC104Config> config) :
+    m_iec104(iec104),
+    m_config(std::move(config)),
+    m_filter(*m_config),
+    m_queue(m_config->application.ingest_queue_size)
+{}
 
-		if (gi_cycle)
-		{
-            m_sendInterrogationCommmands();
-            Thread_sleep(1000 * gi_time);
-        }
 
-		Thread_sleep(1000);
-    }
+IEC104Client::~IEC104Client()
+{
+    stopWorker();
 }
 
 
-/** Disconnect from the iec104 servers */
-void IEC104::stop()
+void IEC104Client::startWorker()
 {
-    delete m_client;
-    m_client = nullptr;
+    if (m_worker_running.exchange(true))
+        return;
 
-    for (auto& connection : m_connections)
-    {
-        // if the connection has already ended, we don't send another close request
-        if (connection)
-        {
-            CS104_Connection_destroy(connection);
-            connection = nullptr;
-            Logger::getLogger()->info("Connection stopped");
-        }
-    }
+    m_worker = thread(&IEC104Client::m_ingestWorker, this);
 }
 
 
-/**
- * Called when a data changed event is received. This calls back to the south service
- * and adds the points to the readings queue to send.
- *
- * @param points    The points in the reading we must create
- */
-void IEC104::ingest(Reading& reading)
+void IEC104Client::stopWorker()
 {
-    (*m_ingest)(m_data, reading);
+    if (!m_worker_running.exchange(false))
+        return;
+
+    m_worker_cv.notify_one();
+    m_worker.join();
 }
 
 
-/**
- * Save the callback function and its data
- * @param data   The Ingest function data
- * @param cb     The callback function to call
- */
-void IEC104::registerIngest(void *data, INGEST_CB cb)
+void IEC104Client::initRecord(IEC104DataRecord& record, CS101_ASDU asdu)
 {
-    m_ingest = cb;
-    m_data = data;
+    record.asdu_id = m_next_asdu_id.fetch_add(1, memory_order_relaxed);
+    record.ca = CS101_ASDU_getCA(asdu);
+    record.oa = CS101_ASDU_getOA(asdu);
+    record.type_id = CS101_ASDU_getTypeID(asdu);
+    record.cot = CS101_ASDU_getCOT(asdu);
+    record.is_test = CS101_ASDU_isTest(asdu);
+    record.is_negative = CS101_ASDU_isNegative(asdu);
+    record.received_ns = IEC104LatencyStats::nowNs();
 }
 
 
-template<class T>
-T IEC104::m_getConfigValue(json configuration, json_pointer<json> path)
+void IEC104Client::flush()
 {
-    T typed_value;
-
-    try
-    { typed_value = configuration.at(path); }
-    catch (json::parse_error& e)
-    { Logger::getLogger()->fatal("Couldn't parse value " + path.to_string() + " : " + e.what()); }
-    catch (json::out_of_range& e)
-    { Logger::getLogger()->fatal("Couldn't reach value " + path.to_string() + " : " + e.what()); }
+    size_t depth = m_queue.size();
+    size_t high_water_mark = m_queue_high_water_mark.load(memory_order_relaxed);
+    while (depth > high_water_mark
+        && !m_queue_high_water_mark.compare_exchange_weak(high_water_mark, depth, memory_order_relaxed)) {}
 
-    return typed_value;
+    if (m_worker_waiting.load())
+        m_worker_cv.notify_one();
 }
 
 
-void IEC104::m_sendInterrogationCommmands()
+/**
+ * The ingest worker is too slow to keep up : sleep until it takes a batch, then retry.
+ * Blocking here stops the connection thread from reading its socket, which is the back
+ * pressure lib60870 applies to the outstation.
+ */
+void IEC104Client::m_pushWhenFull(const IEC104DataRecord& record)
 {
-    int broadcast_ca = m_getBroadcastCA();
+    m_queue_full_waits.fetch_add(1, memory_order_relaxed);
+    m_queue_high_water_mark.store(m_queue.capacity(), memory_order_relaxed);
 
-    int gi_repeat_count = m_getConfigValue<int>(m_stack_configuration, "/application_layer/gi_repeat_count"_json_pointer);
-    int gi_time = m_getConfigValue<int>(m_stack_configuration, "/application_layer/gi_time"_json_pointer);
-
-    // If we try to send to every ca
-    if (m_getConfigValue<bool>(m_stack_configuration, "/application_layer/gi_all_ca"_json_pointer))
-    {
-        // For every ca
-        for (auto& element : m_msg_configuration["asdu_list"])
-            m_sendInterrogationCommmandToCA(m_getConfigValue<unsigned int>(element, "/ca"_json_pointer), gi_repeat_count, gi_time);
-    }
-    else  // Otherwise, broadcast (causes Segmentation fault)
+    // Counted before the queue is checked again so that the worker wakes us, the timeout covers a missed wakeup
+    m_producers_waiting.fetch_add(1);
+    while (!m_queue.tryPush(record))
     {
-        //m_sendInterrogationCommmandToCA(broadcast_ca, gi_repeat_count, gi_time);
-    }
+        m_worker_cv.notify_one();
 
-    Logger::getLogger()->info("Interrogation command sent");
+        unique_lock<mutex> lock(m_space_mutex);
+        if (m_queue.size() >= m_queue.capacity())
+            m_space_cv.wait_for(lock, chrono::milliseconds(10));
+    }
+    m_producers_waiting.fetch_sub(1);
 }
 
 
-void IEC104::m_sendInterrogationCommmandToCA(unsigned int ca, int gi_repeat_count, int gi_time)
+/**
+ * Ingest worker : drains the queue in batches, builds the pivot Readings and calls
+ * the ingest callback, outside of the lib60870 receive threads.
+ */
+void IEC104Client::m_ingestWorker()
 {
-    Logger::getLogger()->info("Sending interrogation command to ca = " + to_string(ca));
+    const size_t max_batch = 1024;
+    vector<IEC104DataRecord> batch(max_batch);
 
-    // Try gi_repeat_count times if doesn't work
-	bool sentWithSuccess = false;
-    for (unsigned int count = 0; count < gi_repeat_count; count++)
+    while (true)
     {
-        for (auto connection : m_connections)
+        size_t count = 0;
+        while (count < max_batch && m_queue.tryPop(batch[count]))
+            count++;
+
+        if (count > 0 && m_producers_waiting.load() > 0)
         {
-            // If it does work, wait gi_time seconds to complete, and break
-            if (CS104_Connection_sendInterrogationCommand(connection, CS101_COT_ACTIVATION, ca, IEC60870_QOI_STATION))
-            {
-				sentWithSuccess = true;
-                Thread_sleep(1000 * gi_time);
-                break;
-            }
+            lock_guard<mutex> lock(m_space_mutex);
+            m_space_cv.notify_all();
         }
-		if (sentWithSuccess)
-			break;
+
+        if (count > 0)
+        {
+            sendData(batch.data(), count);
+            continue;
+        }
+
+        // Queue is empty : leave once stopped, otherwise sleep until flush() or the timeout
+        if (!m_worker_running.load())
+            break;
+
+        unique_lock<mutex> lock(m_worker_mutex);
+        m_worker_waiting.store(true);
+        if (m_queue.size() == 0 && m_worker_running.load())
+            m_worker_cv.wait_for(lock, chrono::milliseconds(10));
+        m_worker_waiting.store(false);
     }
 }
 
 
-void IEC104::m_sendTestCommmands()
+Datapoint* IEC104Client::m_createHeader(const IEC104DataRecord& record)
 {
-    Logger::getLogger()->info("Sending interrogation command...");
+    auto* data_header = new vector<Datapoint*>;
+    data_header->reserve(m_config->pivot.data_object_header.size());
 
-	// For every ca
-    for (auto& element : m_msg_configuration["asdu_list"])
-	{
-        int ca = m_getConfigValue<unsigned int>(element, "/ca"_json_pointer);
-        for (auto connection : m_connections)
+    for (auto& op : m_config->pivot.data_object_header)
+    {
+        switch (op.field)
         {
-            if (m_comm_wttag) {
-                uint16_t tsc = 0; //Test sequence counter
-                CP56Time2a currentTime = CP56Time2a_createFromMsTimestamp(nullptr, Hal_getTimeInMs());
-                CS104_Connection_sendTestCommandWithTimestamp(connection, ca, tsc, currentTime);
-            } else
-                CS104_Connection_sendTestCommand(connection, ca);
+            case IEC104PivotField::TYPE_ID:
+                data_header->push_back(m_createDatapoint(op.key, (long) record.type_id));
+                break;
+            case IEC104PivotField::CA:
+                data_header->push_back(m_createDatapoint(op.key, (long) record.ca));
+                break;
+            case IEC104PivotField::OA:
+                data_header->push_back(m_createDatapoint(op.key, (long) record.oa));
+                break;
+            case IEC104PivotField::COT:
+                data_header->push_back(m_createDatapoint(op.key, (long) record.cot));
+                break;
+            case IEC104PivotField::IS_TEST:
+                data_header->push_back(m_createDatapoint(op.key, (long) record.is_test));
+                break;
+            case IEC104PivotField::IS_NEGATIVE:
+                data_header->push_back(m_createDatapoint(op.key, (long) record.is_negative));
+                break;
+            default:
+                break;
         }
-	}
-    Logger::getLogger()->info("Test command sent");
-}
-
+    }
 
-int IEC104::m_getBroadcastCA()
-{
-    int ca_asdu_size = m_getConfigValue<int>(m_stack_configuration, "/application_layer/ca_asdu_size"_json_pointer);
+    DatapointValue header_dpv(data_header, true);
 
-    // Broadcast address is the maximum value possible, ie 2^(8*asdu_size) (8 is 1 byte)
-    // https://www.openmuc.org/iec-60870-5-104/javadoc/org/openmuc/j60870/ASdu.html
-    return pow(2, 8 * ca_asdu_size) - 1;
+    return new Datapoint("data_object_header", header_dpv);
 }
 
 
-std::string IEC104::m_checkExchangedDataLayer(unsigned int ca, const string& type_id, unsigned int ioa)
+void IEC104Client::sendData(const IEC104DataRecord* records, size_t count)
 {
-	bool known_ca = false, known_type_id = false;
-	
-	//Logger::getLogger()->warn("Checking " + to_string(ca) + " " + type_id + " " + to_string(ioa));
-	for (auto& element : m_msg_configuration["asdu_list"])
-	{
-		if (m_getConfigValue<unsigned int>(element, "/ca"_json_pointer) == ca)
-		{
-			known_ca = true;
-			if (m_getConfigValue<string>(element, "/type_id"_json_pointer) == type_id)
-			{
-				known_type_id = true;
-				if (m_getConfigValue<unsigned int>(element, "/ioa"_json_pointer) == ioa)
-					//Logger::getLogger()->warn("Ok for " + to_string(ca) + " " + type_id + " " + to_string(ioa));
-					return element["label"];
-			}
-		}
-	}
+    // We send as many pivot format objects as information objects in the source ASDUs,
+    // and all of them in a single ingest call
+    auto* readings = new vector<Reading*>;
+    readings->reserve(count);
 
-	if (!known_ca)
-		Logger::getLogger()->warn("Unknown CA (" + to_string(ca) +") for ASDU");
-	else if (!known_type_id)
-		Logger::getLogger()->warn("Unknown type_id (" + type_id +") for ASDU");
-	else
-		Logger::getLogger()->warn("Unknown IOA (" + to_string(ioa) +") for ASDU " + type_id);
+    vector<Datapoint*> datapoints;
+    Datapoint* header_template = nullptr;
 
-	return "";
-}
+    // One clock read per Reading : each one ends the PIVOT stage of a record and starts the next.
+    // They cost more than a few percent of the pivot build, so they are only made with latency_stats.
+    const bool latency_stats = m_config->application.latency_stats;
+    uint64_t batch_start_ns = latency_stats ? IEC104LatencyStats::nowNs() : 0;
+    uint64_t pivot_start_ns = batch_start_ns;
 
+    for (size_t i = 0; i < count; i++)
+    {
+        const IEC104DataRecord& record = records[i];
+        const IEC104DataPoint& point = m_config->points[record.point_id];
+
+        if (latency_stats)
+            m_latency.record(IEC104LatencyStage::QUEUE, record.type_id, batch_start_ns - record.received_ns);
+
+        // The header is built once per ASDU. A Reading owns and deletes its datapoints,
+        // so every Reading of the ASDU gets its own copy of it, but the last one which
+        // takes the template itself.
+        if (header_template == nullptr)
+            header_template = m_createHeader(record);
+
+        Datapoint* header_dp;
+        if (i + 1 < count && records[i + 1].asdu_id == record.asdu_id)
+            header_dp = new Datapoint(*header_template);
+        else
+        {
+            header_dp = header_template;
+            header_template = nullptr;
+        }
 
-CS104_Connection IEC104::m_createTlsConnection(const char *ip, int port) {
-    TLSConfiguration TLSConfig = TLSConfiguration_create(); //TLSConfiguration_create makes plugin unresponsive, without giving any log/exception
-    Logger::getLogger()->debug("Af TLSConf create");
+        CP56Time2a ts = record.has_timestamp ? const_cast<CP56Time2a>(&record.timestamp) : nullptr;
 
-    std::string private_key = "$FLEDGE_ROOT/data/etc/certs/" + m_getConfigValue<string>(m_tls_configuration, "/private_key"_json_pointer);
-    std::string server_cert = "$FLEDGE_ROOT/data/etc/certs/" + m_getConfigValue<string>(m_tls_configuration, "/server_cert"_json_pointer);
-    std::string ca_cert     = "$FLEDGE_ROOT/data/etc/certs/" + m_getConfigValue<string>(m_tls_configuration, "/ca_cert"_json_pointer);
+        datapoints.clear();
+        if (record.is_float)
+            addData(datapoints, record.ioa, point.label, (float) record.value.real, record.quality, ts);
+        else
+            addData(datapoints, record.ioa, point.label, (long) record.value.integer, record.quality, ts);
 
-    TLSConfiguration_setOwnCertificateFromFile(TLSConfig, server_cert.c_str());
-    TLSConfiguration_setOwnKeyFromFile(TLSConfig, private_key.c_str(), nullptr);
-    TLSConfiguration_addCACertificateFromFile(TLSConfig, ca_cert.c_str());
+        auto* reading = new Reading(point.label, {header_dp, datapoints.front()});
 
-    return CS104_Connection_createSecure(ip, port, TLSConfig);
-}
+        // The time tag of the source is the user timestamp of the Reading
+        if (ts != nullptr)
+        {
+            int64_t ms = m_timeToEpochMs(ts);
+            struct timeval user_ts;
+            user_ts.tv_sec = ms / 1000;
+            user_ts.tv_usec = (ms % 1000) * 1000;
+            reading->setUserTimestamp(user_ts);
+        }
 
+        readings->push_back(reading);
 
-int IEC104::m_watchdog(int delay, int checkRes, bool *flag, std::string id)
-{
-	using namespace std::chrono;
-	high_resolution_clock::time_point beginning_time = high_resolution_clock::now();
-	while(true)
-	{
-		std::this_thread::sleep_for(std::chrono::milliseconds(checkRes));
-		high_resolution_clock::time_point current_time = high_resolution_clock::now();
-		duration<double, std::milli> time_span = current_time - beginning_time;
-		if (*flag) //Operation has been validated
-		{
-			Logger::getLogger()->info(id + " completed in " + to_string(time_span.count() / 1000) + " seconds.");
-			return 0;
-		}
-		else //Operation has not been validated yet
-		{
-			if (time_span.count() > 1000 * delay) //Time has expired
-			{
-				Logger::getLogger()->warn(id + " is taking to long, restarting ...");
-				return 1;
-			}
-		}
-	}
-}
+        if (latency_stats)
+        {
+            uint64_t pivot_end_ns = IEC104LatencyStats::nowNs();
+            m_latency.record(IEC104LatencyStage::PIVOT, record.type_id, pivot_end_ns - pivot_start_ns);
+            pivot_start_ns = pivot_end_ns;
+        }
+    }
 
+    if (latency_stats)
+        m_latency.record(IEC104LatencyStage::SEND_DATA, pivot_start_ns - batch_start_ns);
 
-void IEC104Client::sendData(CS101_ASDU asdu, vector<Datapoint*> datapoints, const std::string& dataName)
-{
-    auto* data_header = new vector<Datapoint*>;
+    m_iec104->ingest(readings, records[count - 1].received_ns);
 
-    for (auto& feature : (*m_pivot_configuration)["mapping"]["data_object_header"].items())
-    {
-        if (feature.value() == "type_id")
-            data_header->push_back(m_createDatapoint(feature.key(), (long) CS101_ASDU_getTypeID(asdu)));
-        else if (feature.value() == "ca")
-            data_header->push_back(m_createDatapoint(feature.key(), (long) CS101_ASDU_getCA(asdu)));
-        else if (feature.value() == "oa")
-            data_header->push_back(m_createDatapoint(feature.key(), (long) CS101_ASDU_getOA(asdu)));
-        else if (feature.value() == "cot")
-            data_header->push_back(m_createDatapoint(feature.key(), (long) CS101_ASDU_getCOT(asdu)));
-        else if (feature.value() == "istest")
-            data_header->push_back(m_createDatapoint(feature.key(), (long) CS101_ASDU_isTest(asdu)));
-        else if (feature.value() == "isnegative")
-            data_header->push_back(m_createDatapoint(feature.key(), (long) CS101_ASDU_isNegative(asdu)));
-    }
+    if (!latency_stats)
+        return;
 
-    DatapointValue header_dpv(data_header, true);
+    uint64_t ingested_ns = IEC104LatencyStats::nowNs();
+    m_latency.record(IEC104LatencyStage::INGEST, ingested_ns - pivot_start_ns);
+    for (size_t i = 0; i < count; i++)
+        m_latency.record(IEC104LatencyStage::END_TO_END, records[i].type_id, ingested_ns - records[i].received_ns);
+}
 
-    auto* header_dp = new Datapoint("data_object_header", header_dpv);
 
-    // We send as many pivot format objects as information objects in the source ASDU
-    for (Datapoint* item_dp : datapoints)
+Datapoint* IEC104Client::m_createTimeMarker(const std::string& dataname, const CP56Time2a ts)
+{
+    switch (m_config->pivot.time_marker_format)
     {
-        Reading reading(dataName, {header_dp, item_dp});
-        m_iec104->ingest(reading);
+        case IEC104TimeMarkerFormat::EPOCH_MS:
+            return m_createDatapoint(dataname, (long) (ts != nullptr ? m_timeToEpochMs(ts) : -1));
+        case IEC104TimeMarkerFormat::EPOCH_US:
+            return m_createDatapoint(dataname, (long) (ts != nullptr ? m_timeToEpochMs(ts) * 1000 : -1));
+        default:
+            return m_createDatapoint(dataname, (ts != nullptr ? m_timeToString(ts) : "not_populated"));
     }
 }
 
@@ -726,30 +1690,36 @@ void IEC104Client::m_addData(vector<Datapoint*>& datapoints, long ioa,
 {
     auto* measure_features = new vector<Datapoint*>;
 
-    for (auto& feature : (*m_pivot_configuration)["mapping"]["data_object_item"].items())
-    {
-        if (feature.value() == "ioa")
-            measure_features->push_back(m_createDatapoint(feature.key(), ioa));
-        else if (feature.value() == "value")
-            measure_features->push_back(m_createDatapoint(feature.key(), value));
-        else if (feature.value() == "quality_desc")
-            measure_features->push_back(m_createDatapoint(feature.key(), (long) qd));
-		else if (feature.value() == "time_marker")
-            measure_features->push_back(m_createDatapoint(feature.key(), (ts != nullptr ? CP56Time2aToString(ts) : "not_populated")));
-        else if (feature.value() == "isinvalid")
-            measure_features->push_back(m_createDatapoint(feature.key(), (ts != nullptr ? (long) CP56Time2a_isInvalid(ts) : -1)));
-        else if (feature.value() == "isSummerTime")
-            measure_features->push_back(m_createDatapoint(feature.key(), (ts != nullptr ? (long) CP56Time2a_isSummerTime(ts) : -1)));
-        else if (feature.value() == "isSubstituted")
-            measure_features->push_back(m_createDatapoint(feature.key(), (ts != nullptr ? (long) CP56Time2a_isSubstituted(ts) : -1)));
-        /*else if (feature.value() == "time_marker")
-            measure_features->push_back(m_createDatapoint(feature.key(), (ts != nullptr ? CP56Time2aToString(ts) : "not_populated")));
-        else if (feature.value() == "isinvalid")
-            measure_features->push_back(m_createDatapoint(feature.key(), (ts != nullptr ? to_string(CP56Time2a_isInvalid(ts)) : "not_populated")));
-        else if (feature.value() == "isSummerTime")
-            measure_features->push_back(m_createDatapoint(feature.key(), (ts != nullptr ? to_string(CP56Time2a_isSummerTime(ts)) : "not_populated")));
-        else if (feature.value() == "isSubstituted")
-            measure_features->push_back(m_createDatapoint(feature.key(), (ts != nullptr ? to_string(CP56Time2a_isSubstituted(ts)) : "not_populated")));*/
+    measure_features->reserve(m_config->pivot.data_object_item.size());
+
+    for (auto& op : m_config->pivot.data_object_item)
+    {
+        switch (op.field)
+        {
+            case IEC104PivotField::IOA:
+                measure_features->push_back(m_createDatapoint(op.key, ioa));
+                break;
+            case IEC104PivotField::VALUE:
+                measure_features->push_back(m_createDatapoint(op.key, value));
+                break;
+            case IEC104PivotField::QUALITY_DESC:
+                measure_features->push_back(m_createDatapoint(op.key, (long) qd));
+                break;
+            case IEC104PivotField::TIME_MARKER:
+                measure_features->push_back(m_createTimeMarker(op.key, ts));
+                break;
+            case IEC104PivotField::IS_INVALID:
+                measure_features->push_back(m_createDatapoint(op.key, (ts != nullptr ? (long) CP56Time2a_isInvalid(ts) : -1)));
+                break;
+            case IEC104PivotField::IS_SUMMER_TIME:
+                measure_features->push_back(m_createDatapoint(op.key, (ts != nullptr ? (long) CP56Time2a_isSummerTime(ts) : -1)));
+                break;
+            case IEC104PivotField::IS_SUBSTITUTED:
+                measure_features->push_back(m_createDatapoint(op.key, (ts != nullptr ? (long) CP56Time2a_isSubstituted(ts) : -1)));
+                break;
+            default:
+                break;
+        }
     }
 
     DatapointValue dpv(measure_features, true);
@@ -762,8 +1732,84 @@ void IEC104Client::m_addData(vector<Datapoint*>& datapoints, long ioa,
  */
 bool IEC104::operation(const std::string& operation, int count, PLUGIN_PARAMETER **params)
 {
-    for (auto connection : m_connections)
+    // Statistics query : the statistics Reading is ingested at once, then optionally reset
+    if (operation.compare("latency_stats") == 0)
+    {
+        bool reset = count > 0 && params[0]->name == "reset" && params[0]->value == "true";
+        bool scheduled = m_scheduler.schedule(0, [this, reset]()
+        {
+            m_sendStatistics();
+            if (reset)
+                m_client->latency().reset();
+        }) != 0;
+
+        if (!scheduled)
+            Logger::getLogger()->error("iec104 not started, operation %s ignored", operation.c_str());
+        return scheduled;
+    }
+
+    // Replay of a capture file, with the parameters file and speed (0 for as fast as possible)
+    if (operation.compare("replay") == 0)
+    {
+        string file;
+        double speed = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (params[i]->name == "file")
+                file = params[i]->value;
+            else if (params[i]->name == "speed")
+                speed = atof(params[i]->value.c_str());
+        }
+
+        if (file.empty() || m_client == nullptr || m_replay_running)
+        {
+            Logger::getLogger()->error("No file, iec104 not started or replay in progress, operation %s ignored",
+                                       operation.c_str());
+            return false;
+        }
+
+        if (m_replay_thread.joinable())
+            m_replay_thread.join();
+
+        m_replay_running = true;
+        m_replay_thread = thread([this, file, speed]()
+        {
+            auto start = chrono::steady_clock::now();
+            uint64_t asdus = replay(file, speed);
+            double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            Logger::getLogger()->info("Replayed " + to_string(asdus) + " ASDUs of " + file + " in "
+                                      + to_string(elapsed) + " s");
+            m_replay_running = false;
+        });
+        return true;
+    }
+
+    // Called by the south service : the lock keeps the scheduler from replacing the connection meanwhile
+    lock_guard<mutex> lock(m_paths_mutex);
+
+    // Raw APDU capture switch, enable=false to pause it
+    if (operation.compare("capture") == 0)
+    {
+        if (!m_capture)
+        {
+            Logger::getLogger()->error("No capture_file configured, operation %s ignored", operation.c_str());
+            return false;
+        }
+
+        bool enable = !(count > 0 && params[0]->name == "enable" && params[0]->value == "false");
+        m_capture->setEnabled(enable);
+        Logger::getLogger()->info("Raw APDU capture %s", enable ? "enabled" : "disabled");
+        return true;
+    }
+
+    for (auto& path : m_paths)
     {
+        if (!path.started)
+            continue;
+
+        CS104_Connection connection = path.connection;
+
         if (operation.compare("CS104_Connection_sendInterrogationCommand") == 0)
         {       
                 int casdu = atoi(params[0]->value.c_str());
@@ -805,4 +1851,7 @@ bool IEC104::operation(const std::string& operation, int count, PLUGIN_PARAMETER
         Logger::getLogger()->error("Unrecognised operation %s", operation.c_str());
         return false;
     }
+
+    Logger::getLogger()->error("No connection established, operation %s not sent", operation.c_str());
+    return false;
 }
\ No newline at end of file
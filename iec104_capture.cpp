@@ -0,0 +1,226 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <iec104_capture.h>
+#include <logger.h>
+
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+using namespace std;
+
+// The ring starts on its own cache line
+static const size_t HEADER_SIZE = 64;
+static_assert(sizeof(IEC104CaptureHeader) <= HEADER_SIZE, "capture header too large");
+
+// Big enough for many APDUs of 255 bytes
+static const size_t MIN_CAPACITY = 64 * 1024;
+
+
+static uint64_t steadyNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+IEC104Capture::~IEC104Capture()
+{
+    if (m_header != nullptr)
+        munmap(m_header, m_mapped_size);
+}
+
+
+bool IEC104Capture::open(const string& file, size_t size, unsigned int paths)
+{
+    size_t capacity = size & ~(size_t) 7;
+    if (capacity < MIN_CAPACITY)
+    {
+        Logger::getLogger()->error("Capture size of %zu bytes too small, capture disabled", size);
+        return false;
+    }
+
+    int fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        Logger::getLogger()->error("Couldn't open capture file %s : %s", file.c_str(), strerror(errno));
+        return false;
+    }
+
+    m_mapped_size = HEADER_SIZE + capacity;
+    void* mapping = MAP_FAILED;
+    if (ftruncate(fd, m_mapped_size) == 0)
+        mapping = mmap(nullptr, m_mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        Logger::getLogger()->error("Couldn't map capture file %s : %s", file.c_str(), strerror(error));
+        return false;
+    }
+
+    // The file is zero filled by ftruncate
+    m_header = static_cast<IEC104CaptureHeader*>(mapping);
+    m_ring = static_cast<uint8_t*>(mapping) + HEADER_SIZE;
+
+    memcpy(m_header->magic, "IEC104CP", sizeof(m_header->magic));
+    m_header->version = IEC104CaptureHeader::VERSION;
+    m_header->header_size = HEADER_SIZE;
+    m_header->capacity = capacity;
+    m_header->start_steady_ns = steadyNs();
+    m_header->start_epoch_ns = chrono::duration_cast<chrono::nanoseconds>(
+                                   chrono::system_clock::now().time_since_epoch()).count();
+    m_header->head.store(0, memory_order_release);
+
+    m_sources.clear();
+    for (unsigned int i = 0; i < paths; i++)
+        m_sources.push_back(Source{this, (uint8_t) i});
+
+    Logger::getLogger()->info("Capturing raw APDUs to %s, %zu bytes ring", file.c_str(), capacity);
+    return true;
+}
+
+
+void IEC104Capture::m_write(uint8_t path, IEC104CaptureRecord::Direction direction, const uint8_t* apdu, int length)
+{
+    if (length <= 0 || length > 0xffff)
+        return;
+
+    const uint64_t capacity = m_header->capacity;
+    const uint64_t size = (sizeof(IEC104CaptureRecord) + length + 7) & ~(uint64_t) 7;
+
+    // Reserve the record, and the end of the ring too when the record does not fit before it
+    uint64_t head = m_header->head.load(memory_order_relaxed);
+    uint64_t skip, position;
+    do
+    {
+        uint64_t left = capacity - head % capacity;
+        skip = left < size ? left : 0;
+        position = head + skip;
+    }
+    while (!m_header->head.compare_exchange_weak(head, position + size, memory_order_relaxed));
+
+    auto commit = [this](uint64_t position, uint64_t size, uint8_t path, uint8_t direction,
+                         const uint8_t* apdu, uint16_t length)
+    {
+        auto* record = reinterpret_cast<IEC104CaptureRecord*>(m_ring + position % m_header->capacity);
+
+        // Readers must not take the previous record at this place for a complete one
+        __atomic_store_n(&record->position, ~(uint64_t) 0, __ATOMIC_RELAXED);
+        atomic_thread_fence(memory_order_release);
+
+        record->timestamp_ns = steadyNs();
+        record->size = (uint32_t) size;
+        record->length = length;
+        record->path = path;
+        record->direction = direction;
+        if (length > 0)
+            memcpy(record + 1, apdu, length);
+
+        __atomic_store_n(&record->position, position, __ATOMIC_RELEASE);
+    };
+
+    if (skip >= sizeof(IEC104CaptureRecord))
+        commit(head, skip, path, IEC104CaptureRecord::PADDING, nullptr, 0);
+
+    commit(position, size, path, direction, apdu, (uint16_t) length);
+}
+
+
+void IEC104Capture::rawMessageHandler(void* parameter, uint8_t* msg, int msgSize, bool sent)
+{
+    auto* source = static_cast<Source*>(parameter);
+    source->capture->write(source->path, sent, msg, msgSize);
+}
+
+
+IEC104CaptureReader::~IEC104CaptureReader()
+{
+    if (m_header != nullptr)
+        munmap(const_cast<IEC104CaptureHeader*>(m_header), m_mapped_size);
+}
+
+
+bool IEC104CaptureReader::open(const string& file)
+{
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        Logger::getLogger()->error("Couldn't open capture file %s : %s", file.c_str(), strerror(errno));
+        return false;
+    }
+
+    off_t file_size = lseek(fd, 0, SEEK_END);
+    void* mapping = MAP_FAILED;
+    if (file_size >= (off_t) HEADER_SIZE)
+        mapping = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        Logger::getLogger()->error("Couldn't map capture file %s", file.c_str());
+        return false;
+    }
+
+    m_header = static_cast<const IEC104CaptureHeader*>(mapping);
+    m_mapped_size = file_size;
+
+    if (memcmp(m_header->magic, "IEC104CP", sizeof(m_header->magic)) != 0
+        || m_header->version != IEC104CaptureHeader::VERSION
+        || m_header->header_size + m_header->capacity > (uint64_t) file_size || m_header->capacity % 8 != 0)
+    {
+        Logger::getLogger()->error("%s is not a capture file", file.c_str());
+        return false;
+    }
+
+    m_ring = static_cast<const uint8_t*>(mapping) + m_header->header_size;
+    m_end = m_header->head.load(memory_order_acquire);
+    m_position = m_end > m_header->capacity ? m_end - m_header->capacity : 0;
+    return true;
+}
+
+
+bool IEC104CaptureReader::next(const IEC104CaptureRecord*& record, const uint8_t*& apdu)
+{
+    const uint64_t capacity = m_header->capacity;
+
+    while (m_position + sizeof(IEC104CaptureRecord) <= m_end)
+    {
+        uint64_t left = capacity - m_position % capacity;
+        if (left < sizeof(IEC104CaptureRecord))
+        {
+            m_position += left;
+            continue;
+        }
+
+        record = reinterpret_cast<const IEC104CaptureRecord*>(m_ring + m_position % capacity);
+
+        // Past the oldest record, being overwritten, or not complete : look for the next one
+        if (__atomic_load_n(&record->position, __ATOMIC_ACQUIRE) != m_position || record->size > left
+            || record->size < sizeof(IEC104CaptureRecord) + record->length || m_position + record->size > m_end)
+        {
+            m_position += 8;
+            continue;
+        }
+
+        m_position += record->size;
+        if (record->direction == IEC104CaptureRecord::PADDING)
+            continue;
+
+        apdu = reinterpret_cast<const uint8_t*>(record + 1);
+        return true;
+    }
+    return false;
+}
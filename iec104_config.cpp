@@ -0,0 +1,443 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <iec104_config.h>
+#include <lib60870/cs104_connection.h>
+#include <json.hpp> // https://github.com/nlohmann/json
+#include <cstdlib>
+
+
+using namespace std;
+using namespace nlohmann;
+
+
+namespace {
+
+json parseSection(const string& configuration, const string& section)
+{
+    json root;
+    try
+    { root = json::parse(configuration); }
+    catch (json::parse_error& e)
+    { throw IEC104ConfigError("Couldn't read " + section + " json config string : " + string(e.what())); }
+
+    if (!root.is_object() || !root.contains(section))
+        throw IEC104ConfigError("Missing " + section + " object in " + section + " json config string");
+
+    return root[section];
+}
+
+
+/** Read a mandatory value, reporting the full path of the value on error */
+template <class T>
+T getValue(const json& configuration, const string& section, const string& path)
+{
+    try
+    { return configuration.at(json::json_pointer(path)).get<T>(); }
+    catch (json::out_of_range& e)
+    { throw IEC104ConfigError("Couldn't reach value " + section + path + " : " + e.what()); }
+    catch (json::type_error& e)
+    { throw IEC104ConfigError("Wrong type for value " + section + path + " : " + e.what()); }
+}
+
+
+/** Read an optional value, falling back to default_value when it is not set */
+template <class T>
+T getValue(const json& configuration, const string& section, const string& path, const T& default_value)
+{
+    if (!configuration.contains(json::json_pointer(path)))
+        return default_value;
+
+    return getValue<T>(configuration, section, path);
+}
+
+
+void checkRange(const string& name, long value, long min, long max)
+{
+    if (value < min || value > max)
+        throw IEC104ConfigError(name + " = " + to_string(value) + " is out of range [" + to_string(min) + ", " + to_string(max) + "]");
+}
+
+
+bool isMeasuredValue(int type_id)
+{
+    switch (type_id)
+    {
+        case M_ME_NA_1: case M_ME_TA_1: case M_ME_TD_1:
+        case M_ME_NB_1: case M_ME_TB_1: case M_ME_TE_1:
+        case M_ME_NC_1: case M_ME_TC_1: case M_ME_TF_1:
+            return true;
+        default:
+            return false;
+    }
+}
+
+
+/**
+ * Optional deadband of an exchanged_data element :
+ *   "deadband" : {"mode" : "absolute", "value" : 0.5}
+ *   "deadband" : {"mode" : "percent", "value" : 1, "range_min" : 0, "range_max" : 400}
+ *   "deadband" : {"mode" : "integral", "value" : 20}
+ * The range of a percent deadband defaults to [-1, 1] for normalized values.
+ */
+IEC104Deadband parseDeadband(const json& element, const string& element_section, int type_id)
+{
+    IEC104Deadband deadband{IEC104DeadbandMode::NONE, 0};
+    if (!element.contains("deadband"))
+        return deadband;
+
+    const string section = element_section + "/deadband";
+    if (!isMeasuredValue(type_id))
+        throw IEC104ConfigError(section + " : deadbands only apply to measured values (M_ME_*)");
+
+    auto mode = getValue<string>(element, element_section, "/deadband/mode");
+    deadband.threshold = getValue<double>(element, element_section, "/deadband/value");
+    if (deadband.threshold < 0)
+        throw IEC104ConfigError(section + "/value must not be negative");
+
+    if (mode == "absolute")
+        deadband.mode = IEC104DeadbandMode::ABSOLUTE;
+    else if (mode == "integral")
+        deadband.mode = IEC104DeadbandMode::INTEGRAL;
+    else if (mode == "percent")
+    {
+        bool normalized = type_id == M_ME_NA_1 || type_id == M_ME_TA_1 || type_id == M_ME_TD_1;
+        bool has_range = element.contains(json::json_pointer("/deadband/range_min"))
+                      || element.contains(json::json_pointer("/deadband/range_max"));
+        if (!normalized && !has_range)
+            throw IEC104ConfigError(section + " : percent deadband needs range_min and range_max");
+
+        double range_min = has_range ? getValue<double>(element, element_section, "/deadband/range_min") : -1.0;
+        double range_max = has_range ? getValue<double>(element, element_section, "/deadband/range_max") : 1.0;
+        if (range_max <= range_min)
+            throw IEC104ConfigError(section + " : range_max must be greater than range_min");
+
+        deadband.mode = IEC104DeadbandMode::PERCENT;
+        deadband.threshold = deadband.threshold * (range_max - range_min) / 100.0;
+    }
+    else
+        throw IEC104ConfigError(section + "/mode must be absolute, percent or integral");
+
+    return deadband;
+}
+
+}
+
+
+shared_ptr<const IEC104Config> IEC104Config::parse(const string& stack_configuration, const string& msg_configuration,
+                                                   const string& pivot_configuration, const string& tls_configuration)
+{
+    shared_ptr<IEC104Config> config(new IEC104Config());
+
+    config->m_parseStack(stack_configuration);
+    config->m_parseExchangedData(msg_configuration);
+    config->m_parsePivot(pivot_configuration);
+
+    // TLS files are only needed, and only checked, when TLS is enabled
+    if (config->transport.tls)
+        config->m_parseTls(tls_configuration);
+
+    for (auto& group : config->application.gi_groups)
+        if (!config->isKnownCA(group.ca))
+            throw IEC104ConfigError("gi_groups : ca " + to_string(group.ca) + " has no point in exchanged_data");
+
+    return config;
+}
+
+
+void IEC104Config::m_parseStack(const string& stack_configuration)
+{
+    const string section = "protocol_stack";
+    json stack = parseSection(stack_configuration, section);
+
+    transport.tls = getValue<bool>(stack, section, "/transport_layer/connection/tls");
+    transport.llevel = getValue<int>(stack, section, "/transport_layer/llevel");
+    transport.k_value = getValue<int>(stack, section, "/transport_layer/k_value");
+    transport.w_value = getValue<int>(stack, section, "/transport_layer/w_value");
+    transport.t0_timeout = getValue<int>(stack, section, "/transport_layer/t0_timeout");
+    transport.t1_timeout = getValue<int>(stack, section, "/transport_layer/t1_timeout");
+    transport.t2_timeout = getValue<int>(stack, section, "/transport_layer/t2_timeout");
+    transport.t3_timeout = getValue<int>(stack, section, "/transport_layer/t3_timeout");
+    transport.conn_all = getValue<bool>(stack, section, "/transport_layer/conn_all");
+    transport.start_all = getValue<bool>(stack, section, "/transport_layer/start_all", false);
+    transport.conn_passv = getValue<bool>(stack, section, "/transport_layer/conn_passv");
+    transport.reconnect_delay_min = getValue<int>(stack, section, "/transport_layer/reconnect_delay_min", 1000);
+    transport.reconnect_delay_max = getValue<int>(stack, section, "/transport_layer/reconnect_delay_max", 60000);
+    transport.capture_file = getValue<string>(stack, section, "/transport_layer/capture_file", string());
+    transport.capture_size = getValue<int>(stack, section, "/transport_layer/capture_size", 64);
+    transport.capture_enabled = getValue<bool>(stack, section, "/transport_layer/capture_enabled", true);
+
+    checkRange("k_value", transport.k_value, 1, 32767);
+    checkRange("w_value", transport.w_value, 1, 32767);
+    if (transport.w_value > transport.k_value)
+        throw IEC104ConfigError("w_value (" + to_string(transport.w_value) + ") must not exceed k_value (" + to_string(transport.k_value) + ")");
+    checkRange("t0_timeout", transport.t0_timeout, 1, 255);
+    checkRange("t1_timeout", transport.t1_timeout, 1, 255);
+    checkRange("t2_timeout", transport.t2_timeout, 1, 255);
+    checkRange("t3_timeout", transport.t3_timeout, 1, 172800);
+    if (transport.t2_timeout >= transport.t1_timeout)
+        throw IEC104ConfigError("t2_timeout must be lower than t1_timeout");
+
+    checkRange("reconnect_delay_min", transport.reconnect_delay_min, 10, 3600000);
+    checkRange("reconnect_delay_max", transport.reconnect_delay_max, transport.reconnect_delay_min, 3600000);
+    checkRange("capture_size", transport.capture_size, 1, 4096);
+
+    json paths;
+    try
+    { paths = stack.at(json::json_pointer("/transport_layer/connection/path")); }
+    catch (json::out_of_range& e)
+    { throw IEC104ConfigError("Couldn't reach value " + section + "/transport_layer/connection/path : " + e.what()); }
+
+    if (!paths.is_array() || paths.empty())
+        throw IEC104ConfigError(section + "/transport_layer/connection/path must be a non empty array");
+
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        const string path_section = section + "/transport_layer/connection/path/" + to_string(i);
+
+        IEC104PathConfig path;
+        path.srv_ip = getValue<string>(paths[i], path_section, "/srv_ip");
+        path.clt_ip = getValue<string>(paths[i], path_section, "/clt_ip", string());
+        path.port = getValue<int>(paths[i], path_section, "/port");
+
+        if (path.srv_ip.empty())
+            throw IEC104ConfigError(path_section + "/srv_ip must not be empty");
+        checkRange(path_section + "/port", path.port, 1, 65535);
+
+        transport.paths.push_back(path);
+    }
+
+    application.orig_addr = getValue<int>(stack, section, "/application_layer/orig_addr");
+    application.ca_asdu_size = getValue<int>(stack, section, "/application_layer/ca_asdu_size");
+    application.ioaddr_size = getValue<int>(stack, section, "/application_layer/ioaddr_size");
+    application.startup_time = getValue<int>(stack, section, "/application_layer/startup_time");
+    application.asdu_size = getValue<int>(stack, section, "/application_layer/asdu_size");
+    application.gi_time = getValue<int>(stack, section, "/application_layer/gi_time");
+    application.gi_cycle = getValue<bool>(stack, section, "/application_layer/gi_cycle");
+    application.gi_all_ca = getValue<bool>(stack, section, "/application_layer/gi_all_ca");
+    application.gi_repeat_count = getValue<int>(stack, section, "/application_layer/gi_repeat_count");
+    application.gi_max_concurrent = getValue<int>(stack, section, "/application_layer/gi_max_concurrent", 1);
+    application.gi_pacing = getValue<int>(stack, section, "/application_layer/gi_pacing", 100);
+    application.utc_time = getValue<bool>(stack, section, "/application_layer/utc_time", false);
+    application.comm_wttag = getValue<bool>(stack, section, "/application_layer/comm_wttag");
+    application.exec_cycl_test = getValue<bool>(stack, section, "/application_layer/exec_cycl_test");
+    application.startup_state = getValue<bool>(stack, section, "/application_layer/startup_state");
+    application.time_sync = getValue<bool>(stack, section, "/application_layer/time_sync");
+    application.ingest_queue_size = getValue<int>(stack, section, "/application_layer/ingest_queue_size", 65536);
+
+    checkRange("orig_addr", application.orig_addr, 0, 255);
+    checkRange("ca_asdu_size", application.ca_asdu_size, 1, 2);
+    checkRange("ioaddr_size", application.ioaddr_size, 1, 3);
+    checkRange("startup_time", application.startup_time, 0, 86400);
+    checkRange("asdu_size", application.asdu_size, 0, 249);
+    checkRange("gi_time", application.gi_time, 0, 86400);
+    checkRange("gi_repeat_count", application.gi_repeat_count, 0, 1000);
+    checkRange("gi_max_concurrent", application.gi_max_concurrent, 1, 64);
+    checkRange("gi_pacing", application.gi_pacing, 0, 60000);
+    checkRange("ingest_queue_size", application.ingest_queue_size, 16, 16777216);
+
+    // If 0 is set in the configuration file, use the maximum value (249 for IEC104)
+    if (application.asdu_size == 0)
+        application.asdu_size = 249;
+
+    string tsiv = getValue<string>(stack, section, "/application_layer/tsiv");
+    if (tsiv != "PROCESS" && tsiv != "REMOVE")
+        throw IEC104ConfigError("tsiv must be PROCESS or REMOVE, not " + tsiv);
+    application.tsiv_process = (tsiv == "PROCESS");
+
+    static const unordered_map<string, IEC104CotClass> cot_classes = {
+        {"spontaneous", IEC104_COT_CLASS_SPONTANEOUS}, {"background", IEC104_COT_CLASS_BACKGROUND},
+        {"interrogated", IEC104_COT_CLASS_INTERROGATED}, {"periodic", IEC104_COT_CLASS_PERIODIC}
+    };
+
+    application.suppress_unchanged = IEC104_COT_CLASS_NONE;
+    auto suppress_unchanged = getValue<vector<string>>(stack, section, "/application_layer/suppress_unchanged", vector<string>());
+    for (auto& name : suppress_unchanged)
+    {
+        auto cot_class = cot_classes.find(name);
+        if (cot_class == cot_classes.end())
+            throw IEC104ConfigError("suppress_unchanged : unknown class " + name
+                                    + ", must be spontaneous, background, interrogated or periodic");
+        application.suppress_unchanged |= cot_class->second;
+    }
+
+    application.unchanged_refresh = getValue<int>(stack, section, "/application_layer/unchanged_refresh", 0);
+    checkRange("unchanged_refresh", application.unchanged_refresh, 0, 10080);
+
+    application.stats_period = getValue<int>(stack, section, "/application_layer/stats_period", 0);
+    checkRange("stats_period", application.stats_period, 0, 86400);
+    application.latency_stats = getValue<bool>(stack, section, "/application_layer/latency_stats", false);
+
+    json gi_groups = getValue<json>(stack, section, "/application_layer/gi_groups", json::array());
+    if (!gi_groups.is_array())
+        throw IEC104ConfigError(section + "/application_layer/gi_groups must be an array");
+
+    for (size_t i = 0; i < gi_groups.size(); i++)
+    {
+        const string group_section = section + "/application_layer/gi_groups/" + to_string(i);
+
+        IEC104GroupInterrogation group;
+        group.ca = getValue<unsigned int>(gi_groups[i], group_section, "/ca");
+        group.group = getValue<int>(gi_groups[i], group_section, "/group");
+        group.period = getValue<int>(gi_groups[i], group_section, "/period");
+
+        checkRange(group_section + "/group", group.group, 1, 16);
+        checkRange(group_section + "/period", group.period, 1, 86400);
+
+        application.gi_groups.push_back(group);
+    }
+}
+
+
+IEC104CotClass IEC104Config::getCotClass(int cot)
+{
+    switch (cot)
+    {
+        case CS101_COT_SPONTANEOUS:
+            return IEC104_COT_CLASS_SPONTANEOUS;
+        case CS101_COT_BACKGROUND_SCAN:
+            return IEC104_COT_CLASS_BACKGROUND;
+        case CS101_COT_PERIODIC:
+            return IEC104_COT_CLASS_PERIODIC;
+        default:
+            // Station and group interrogations (20 to 36), and counter interrogations (37 to 41)
+            return (cot >= CS101_COT_INTERROGATED_BY_STATION && cot <= CS101_COT_REQUESTED_BY_GROUP_4_COUNTER)
+                   ? IEC104_COT_CLASS_INTERROGATED : IEC104_COT_CLASS_NONE;
+    }
+}
+
+
+void IEC104Config::m_parseExchangedData(const string& msg_configuration)
+{
+    const string section = "exchanged_data";
+    json exchanged_data = parseSection(msg_configuration, section);
+
+    if (!exchanged_data.contains("asdu_list") || !exchanged_data["asdu_list"].is_array())
+        throw IEC104ConfigError(section + "/asdu_list must be an array");
+
+    const json& asdu_list = exchanged_data["asdu_list"];
+    const unsigned int max_ioa = (1u << (8 * application.ioaddr_size)) - 1;
+    const unsigned int max_ca = (1u << (8 * application.ca_asdu_size)) - 1;
+
+    points.reserve(asdu_list.size());
+    point_index.reserve(asdu_list.size());
+
+    for (size_t i = 0; i < asdu_list.size(); i++)
+    {
+        const string element_section = section + "/asdu_list/" + to_string(i);
+        const json& element = asdu_list[i];
+
+        auto ca = getValue<unsigned int>(element, element_section, "/ca");
+        auto type_name = getValue<string>(element, element_section, "/type_id");
+        auto ioa = getValue<unsigned int>(element, element_section, "/ioa");
+        auto label = getValue<string>(element, element_section, "/label");
+
+        int type_id = getTypeIdFromString(type_name);
+        if (type_id < 0)
+            throw IEC104ConfigError(element_section + " : unsupported type_id " + type_name);
+        if (ca >= max_ca)
+            throw IEC104ConfigError(element_section + " : ca " + to_string(ca) + " does not fit in ca_asdu_size");
+        if (ioa > max_ioa)
+            throw IEC104ConfigError(element_section + " : ioa " + to_string(ioa) + " does not fit in ioaddr_size");
+        if (label.empty())
+            throw IEC104ConfigError(element_section + " : label must not be empty");
+
+        auto point_id = (unsigned int) points.size();
+        if (!point_index.emplace(getPointKey(ca, type_id, ioa), point_id).second)
+            throw IEC104ConfigError(element_section + " : duplicate point (ca " + to_string(ca) + ", " + type_name + ", ioa " + to_string(ioa) + ")");
+
+        points.push_back(IEC104DataPoint{label, point_id, ca, type_id, ioa,
+                                         parseDeadband(element, element_section, type_id)});
+
+        if (known_cas.insert(ca).second)
+            cas.push_back(ca);
+        known_type_ids.insert(getPointKey(ca, type_id, 0));
+    }
+}
+
+
+void IEC104Config::m_parsePivot(const string& pivot_configuration)
+{
+    const string section = "protocol_translation";
+    json translation = parseSection(pivot_configuration, section);
+
+    static const unordered_map<string, IEC104PivotField> header_fields = {
+        {"type_id", IEC104PivotField::TYPE_ID}, {"ca", IEC104PivotField::CA}, {"oa", IEC104PivotField::OA},
+        {"cot", IEC104PivotField::COT}, {"istest", IEC104PivotField::IS_TEST}, {"isnegative", IEC104PivotField::IS_NEGATIVE}
+    };
+    static const unordered_map<string, IEC104PivotField> item_fields = {
+        {"ioa", IEC104PivotField::IOA}, {"value", IEC104PivotField::VALUE}, {"quality_desc", IEC104PivotField::QUALITY_DESC},
+        {"time_marker", IEC104PivotField::TIME_MARKER}, {"isinvalid", IEC104PivotField::IS_INVALID},
+        {"isSummerTime", IEC104PivotField::IS_SUMMER_TIME}, {"isSubstituted", IEC104PivotField::IS_SUBSTITUTED}
+    };
+
+    auto compile = [&](const string& name, const unordered_map<string, IEC104PivotField>& fields,
+                       vector<IEC104PivotOp>& ops)
+    {
+        const string path = "/mapping/" + name;
+        if (!translation.contains(json::json_pointer(path)) || !translation.at(json::json_pointer(path)).is_object())
+            throw IEC104ConfigError(section + path + " must be an object");
+
+        for (auto& feature : translation.at(json::json_pointer(path)).items())
+        {
+            auto field = feature.value().is_string() ? fields.find(feature.value().get<string>()) : fields.end();
+            if (field == fields.end())
+                throw IEC104ConfigError(section + path + "/" + feature.key() + " : unknown field " + feature.value().dump());
+
+            ops.push_back(IEC104PivotOp{field->second, feature.key()});
+        }
+    };
+
+    compile("data_object_header", header_fields, pivot.data_object_header);
+    compile("data_object_item", item_fields, pivot.data_object_item);
+
+    static const unordered_map<string, IEC104TimeMarkerFormat> time_marker_formats = {
+        {"string", IEC104TimeMarkerFormat::STRING}, {"epoch_ms", IEC104TimeMarkerFormat::EPOCH_MS},
+        {"epoch_us", IEC104TimeMarkerFormat::EPOCH_US}
+    };
+
+    string time_marker_format = getValue<string>(translation, section, "/time_marker_format", string("string"));
+    auto format = time_marker_formats.find(time_marker_format);
+    if (format == time_marker_formats.end())
+        throw IEC104ConfigError(section + "/time_marker_format must be string, epoch_ms or epoch_us");
+    pivot.time_marker_format = format->second;
+}
+
+
+void IEC104Config::m_parseTls(const string& tls_configuration)
+{
+    const string section = "tls_conf";
+    json tls_conf = parseSection(tls_configuration, section);
+
+    const char* fledge_root = getenv("FLEDGE_ROOT");
+    const string certs_dir = string(fledge_root != nullptr ? fledge_root : "/usr/local/fledge") + "/data/etc/certs/";
+
+    tls.private_key = certs_dir + getValue<string>(tls_conf, section, "/private_key");
+    tls.server_cert = certs_dir + getValue<string>(tls_conf, section, "/server_cert");
+    tls.ca_cert = certs_dir + getValue<string>(tls_conf, section, "/ca_cert");
+}
+
+
+int IEC104Config::getTypeIdFromString(const string& type_id)
+{
+    static const unordered_map<string, int> type_ids = {
+        {"M_SP_NA_1", M_SP_NA_1}, {"M_SP_TA_1", M_SP_TA_1}, {"M_SP_TB_1", M_SP_TB_1},
+        {"M_DP_NA_1", M_DP_NA_1}, {"M_DP_TA_1", M_DP_TA_1}, {"M_DP_TB_1", M_DP_TB_1},
+        {"M_ST_NA_1", M_ST_NA_1}, {"M_ST_TA_1", M_ST_TA_1}, {"M_ST_TB_1", M_ST_TB_1},
+        {"M_BO_NA_1", M_BO_NA_1}, {"M_BO_TA_1", M_BO_TA_1}, {"M_BO_TB_1", M_BO_TB_1},
+        {"M_ME_NA_1", M_ME_NA_1}, {"M_ME_TA_1", M_ME_TA_1}, {"M_ME_TD_1", M_ME_TD_1},
+        {"M_ME_NB_1", M_ME_NB_1}, {"M_ME_TB_1", M_ME_TB_1}, {"M_ME_TE_1", M_ME_TE_1},
+        {"M_ME_NC_1", M_ME_NC_1}, {"M_ME_TC_1", M_ME_TC_1}, {"M_ME_TF_1", M_ME_TF_1},
+        {"M_IT_NA_1", M_IT_NA_1}, {"M_IT_TA_1", M_IT_TA_1}, {"M_IT_TB_1", M_IT_TB_1}
+    };
+
+    auto it = type_ids.find(type_id);
+    return it != type_ids.end() ? it->second : -1;
+}
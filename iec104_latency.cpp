@@ -0,0 +1,101 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <iec104_latency.h>
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+uint64_t IEC104Histogram::m_getValue(int index)
+{
+    if (index < SUB_BUCKETS)
+        return index;
+
+    int magnitude = index / SUB_BUCKETS + 3;
+    uint64_t width = (uint64_t) 1 << (magnitude - 4);
+    return (SUB_BUCKETS + index % SUB_BUCKETS) * width + width - 1;
+}
+
+
+uint64_t IEC104Histogram::percentile(double percentile) const
+{
+    uint64_t total = count();
+    if (total == 0)
+        return 0;
+
+    uint64_t target = std::max<uint64_t>(1, (uint64_t) ceil(percentile / 100.0 * total));
+    uint64_t seen = 0;
+
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        seen += m_buckets[i].load(memory_order_relaxed);
+        if (seen >= target)
+            return std::min(m_getValue(i), max());
+    }
+
+    // Buckets and count are not read atomically together, a concurrent record may be missed
+    return max();
+}
+
+
+void IEC104Histogram::reset()
+{
+    for (auto& bucket : m_buckets)
+        bucket.store(0, memory_order_relaxed);
+    m_count.store(0, memory_order_relaxed);
+    m_max.store(0, memory_order_relaxed);
+}
+
+
+IEC104LatencyStats::~IEC104LatencyStats()
+{
+    for (auto& stages : m_by_type)
+        delete stages.load();
+}
+
+
+IEC104LatencyStats::Stages& IEC104LatencyStats::m_allocateTypeStages(int type_id)
+{
+    Stages* stages = new Stages();
+    Stages* expected = nullptr;
+
+    // Another thread may have allocated them first
+    if (!m_by_type[type_id & 0xff].compare_exchange_strong(expected, stages, memory_order_acq_rel))
+    {
+        delete stages;
+        return *expected;
+    }
+    return *stages;
+}
+
+
+void IEC104LatencyStats::reset()
+{
+    for (auto& histogram : m_all.stage)
+        histogram.reset();
+
+    for (auto& stages : m_by_type)
+    {
+        Stages* type_stages = stages.load(memory_order_acquire);
+        if (type_stages != nullptr)
+            for (auto& histogram : type_stages->stage)
+                histogram.reset();
+    }
+}
+
+
+const char* IEC104LatencyStats::getStageName(int stage)
+{
+    static const char* names[STAGES] = {"decode", "lookup", "queue", "pivot", "send_data", "ingest", "end_to_end"};
+    return stage >= 0 && stage < STAGES ? names[stage] : "unknown";
+}
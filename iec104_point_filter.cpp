@@ -0,0 +1,105 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <iec104_point_filter.h>
+#include <lib60870/hal_time.h>
+#include <lib60870/cs104_connection.h>
+#include <cmath>
+#include <thread>
+
+
+using namespace std;
+
+
+IEC104PointFilter::IEC104PointFilter(const IEC104Config& config) :
+    m_states(new PointState[config.points.size()]),
+    m_suppress_unchanged(config.application.suppress_unchanged),
+    m_refresh_ms((uint64_t) config.application.unchanged_refresh * 60000)
+{}
+
+
+bool IEC104PointFilter::accept(const IEC104DataPoint& point, double value, uint8_t quality, int cot)
+{
+    Verdict verdict = FORWARD;
+    bool suppress_unchanged = (m_suppress_unchanged & IEC104Config::getCotClass(cot)) != 0;
+
+    // Values of the classes not suppressed are evaluated too : they are the last reported value of the point
+    if (point.deadband.mode != IEC104DeadbandMode::NONE || m_suppress_unchanged != IEC104_COT_CLASS_NONE)
+    {
+        PointState& state = m_states[point.id];
+
+        while (state.busy.exchange(true, memory_order_acquire))
+            this_thread::yield();
+
+        verdict = m_evaluate(point.deadband, suppress_unchanged, state, value, quality, cot);
+
+        state.busy.store(false, memory_order_release);
+    }
+
+    switch (verdict)
+    {
+        case FORWARD:
+            m_forwarded.fetch_add(1, memory_order_relaxed);
+            return true;
+        case SUPPRESS_DEADBAND:
+            m_suppressed.fetch_add(1, memory_order_relaxed);
+            return false;
+        default:
+            m_suppressed_unchanged.fetch_add(1, memory_order_relaxed);
+            return false;
+    }
+}
+
+
+IEC104PointFilter::Verdict IEC104PointFilter::m_evaluate(const IEC104Deadband& deadband, bool suppress_unchanged,
+                                                         PointState& state, double value, uint8_t quality, int cot)
+{
+    uint64_t now = Hal_getTimeInMs();
+
+    // The previous value was held from its reception until now
+    if (deadband.mode == IEC104DeadbandMode::INTEGRAL && state.reported)
+    {
+        double held_seconds = (double) (now - state.last_time_ms) / 1000.0;
+        state.integral += fabs(state.last_value - state.reported_value) * held_seconds;
+    }
+
+    state.last_value = value;
+    state.last_time_ms = now;
+
+    // The first value, quality changes and points not forwarded for unchanged_refresh are always forwarded
+    Verdict verdict = FORWARD;
+    bool refresh_due = m_refresh_ms > 0 && now - state.reported_time_ms >= m_refresh_ms;
+
+    if (state.reported && quality == state.quality && !refresh_due)
+    {
+        bool interrogated = cot >= CS101_COT_INTERROGATED_BY_STATION && cot <= CS101_COT_INTERROGATED_BY_GROUP_16;
+
+        if (suppress_unchanged && value == state.reported_value)
+            verdict = SUPPRESS_UNCHANGED;
+        // Answers to interrogations are not subject to deadbands
+        else if (interrogated || deadband.mode == IEC104DeadbandMode::NONE)
+            verdict = FORWARD;
+        else if (deadband.mode == IEC104DeadbandMode::INTEGRAL)
+            verdict = state.integral > deadband.threshold ? FORWARD : SUPPRESS_DEADBAND;
+        else
+            verdict = fabs(value - state.reported_value) > deadband.threshold ? FORWARD : SUPPRESS_DEADBAND;
+    }
+
+    if (verdict == FORWARD)
+    {
+        state.reported = true;
+        state.quality = quality;
+        state.reported_value = value;
+        state.reported_time_ms = now;
+        state.integral = 0;
+    }
+
+    return verdict;
+}
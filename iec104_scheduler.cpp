@@ -0,0 +1,221 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <iec104_scheduler.h>
+#include <logger.h>
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <limits>
+
+
+using namespace std;
+
+
+uint64_t IEC104Scheduler::nowMs()
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void IEC104Scheduler::start()
+{
+    lock_guard<mutex> lock(m_mutex);
+    if (m_running)
+        return;
+
+    m_running = true;
+    m_current_ms = nowMs();
+    m_thread = thread(&IEC104Scheduler::m_run, this);
+}
+
+
+void IEC104Scheduler::stop()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (!m_running)
+            return;
+        m_running = false;
+    }
+    m_cv.notify_one();
+
+    if (m_thread.joinable())
+    {
+        // stop() may be called by a task, which cannot join its own thread
+        if (m_thread.get_id() == this_thread::get_id())
+            m_thread.detach();
+        else
+            m_thread.join();
+    }
+
+    lock_guard<mutex> lock(m_mutex);
+    for (auto& slot : m_wheel)
+        slot.clear();
+    m_slot_of.clear();
+    m_due.clear();
+    m_timers = 0;
+}
+
+
+IEC104Scheduler::TimerId IEC104Scheduler::schedule(uint64_t delay_ms, Task task)
+{
+    return scheduleEvery(delay_ms, 0, move(task));
+}
+
+
+IEC104Scheduler::TimerId IEC104Scheduler::scheduleEvery(uint64_t first_delay_ms, uint64_t period_ms, Task task)
+{
+    TimerId id;
+    {
+        lock_guard<mutex> lock(m_mutex);
+        if (!m_running)
+            return 0;
+
+        id = m_next_id++;
+        m_insert(Timer{id, nowMs() + first_delay_ms, period_ms, move(task)});
+    }
+    m_cv.notify_one();
+    return id;
+}
+
+
+void IEC104Scheduler::cancel(TimerId id)
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    if (id != 0 && id == m_running_id)
+    {
+        m_running_cancelled = true;
+        return;
+    }
+
+    // Taken out of the wheel with the batch of due timers : m_run skips it
+    if (m_due.erase(id) > 0)
+        return;
+
+    auto it = m_slot_of.find(id);
+    if (it == m_slot_of.end())
+        return;
+
+    auto& slot = m_wheel[it->second];
+    slot.erase(find_if(slot.begin(), slot.end(), [id](const Timer& timer) { return timer.id == id; }));
+    m_slot_of.erase(it);
+    m_timers--;
+}
+
+
+void IEC104Scheduler::m_insert(Timer timer)
+{
+    // A deadline in the past is visited on the next wake up
+    size_t slot = max(timer.deadline_ms, m_current_ms + 1) % SLOTS;
+
+    m_slot_of[timer.id] = slot;
+    m_wheel[slot].push_back(move(timer));
+    m_timers++;
+}
+
+
+// Earliest deadline of the pending timers, with the lock held
+uint64_t IEC104Scheduler::m_nextDeadline() const
+{
+    uint64_t next = numeric_limits<uint64_t>::max();
+    if (m_timers == 0)
+        return next;
+
+    for (auto& slot : m_wheel)
+        for (auto& timer : slot)
+            next = min(next, timer.deadline_ms);
+
+    return next;
+}
+
+
+void IEC104Scheduler::m_run()
+{
+    vector<Timer> due;
+    unique_lock<mutex> lock(m_mutex);
+
+    while (m_running)
+    {
+        uint64_t now = nowMs();
+
+        // Visit the slots of the elapsed milliseconds, every slot at most once
+        uint64_t first = m_current_ms + 1;
+        if (now >= first + SLOTS)
+            first = now - SLOTS + 1;
+
+        for (uint64_t ms = first; ms <= now; ms++)
+        {
+            auto& slot = m_wheel[ms % SLOTS];
+            for (size_t i = 0; i < slot.size();)
+            {
+                if (slot[i].deadline_ms <= now)
+                {
+                    m_slot_of.erase(slot[i].id);
+                    m_due.insert(slot[i].id);
+                    due.push_back(move(slot[i]));
+                    slot[i] = move(slot.back());
+                    slot.pop_back();
+                    m_timers--;
+                }
+                else
+                    i++;
+            }
+        }
+        if (now > m_current_ms)
+            m_current_ms = now;
+
+        sort(due.begin(), due.end(), [](const Timer& a, const Timer& b) { return a.deadline_ms < b.deadline_ms; });
+
+        for (auto& timer : due)
+        {
+            if (!m_running)
+                break;
+
+            // Cancelled by an earlier task of the batch
+            if (m_due.erase(timer.id) == 0)
+                continue;
+
+            m_running_id = timer.id;
+            m_running_cancelled = false;
+            lock.unlock();
+
+            try
+            { timer.task(); }
+            catch (exception& e)
+            { Logger::getLogger()->error("Scheduled task failed : " + string(e.what())); }
+
+            lock.lock();
+            m_running_id = 0;
+
+            if (timer.period_ms > 0 && !m_running_cancelled && m_running)
+            {
+                // A late periodic timer skips the periods it missed
+                timer.deadline_ms += timer.period_ms;
+                if (timer.deadline_ms <= m_current_ms)
+                    timer.deadline_ms = m_current_ms + timer.period_ms;
+                m_insert(move(timer));
+            }
+        }
+        due.clear();
+        m_due.clear();
+
+        if (!m_running)
+            break;
+
+        uint64_t next = m_nextDeadline();
+        now = nowMs();
+        if (next == numeric_limits<uint64_t>::max())
+            m_cv.wait(lock);
+        else if (next > now)
+            m_cv.wait_for(lock, chrono::milliseconds(next - now));
+    }
+}
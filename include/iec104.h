@@ -24,18 +24,76 @@
 #include <lib60870/cs104_connection.h>
 #include <utility>
 #include <plugin_api.h>
-#include <json.hpp> // https://github.com/nlohmann/json
+#include <iec104_config.h>
+#include <iec104_ring_buffer.h>
+#include <iec104_time_format.h>
+#include <iec104_point_filter.h>
+#include <iec104_scheduler.h>
+#include <iec104_latency.h>
+#include <iec104_capture.h>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <memory>
 #include <mutex>
+#include <condition_variable>
+#include <random>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
 
 
 class IEC104Client;
+class IEC104ElementReader;
+
+enum class IEC104PathState
+{
+    IDLE,           // Not connected yet
+    CONNECTING,     // Asynchronous connection in progress
+    CONNECTED,      // Connection established and started
+    BACKOFF         // Connection failed or lost, waiting before the next attempt
+};
+
+/** One redundant path to the outstation, and where its connection stands */
+struct IEC104Path
+{
+    CS104_Connection            connection = nullptr;
+    IEC104PathState             state = IEC104PathState::IDLE;
+    bool                        started = false;        // STARTDT sent : commands are sent and data received on this path
+    unsigned int                failures = 0;           // Consecutive failed attempts, for the backoff delay
+    IEC104Scheduler::TimerId    timer = 0;              // Connection timeout, or end of the backoff delay
+
+    // Startup timings, in IEC104Scheduler::nowMs() time, 0 until reached
+    uint64_t                    connect_start_ms = 0;
+    uint64_t                    connected_ms = 0;
+    uint64_t                    startdt_ms = 0;
+    uint64_t                    startdt_con_ms = 0;
+};
+
+/** An interrogation or test command for a CA, followed until its ACTTERM or ACTCON */
+struct IEC104Command
+{
+    enum Kind { INTERROGATION, TEST };
+
+    Kind                        kind = INTERROGATION;
+    unsigned int                ca = 0;
+    int                         qoi = 0;            // IEC60870_QOI_STATION, or 21 to 36 for groups 1 to 16
+    int                         attempts = 0;
+    bool                        confirmed = false;  // ACTCON received
+    uint64_t                    sent_ms = 0;
+    uint64_t                    sequence = 0;       // Number of the current attempt, among all the attempts sent
+    IEC104Scheduler::TimerId    timer = 0;          // Timeout of the current attempt
+};
 
 class IEC104
 {
+    // benchmark/iec104_bench.cpp drives the receive path directly, the unit tests the command planner
+    friend class IEC104Bench;
+    friend class IEC104Test;
+
 public:
     typedef void (*INGEST_CB)(void *, Reading);
+    typedef void (*INGEST_CB2)(void *, std::vector<Reading *>*);
 
 
     IEC104();
@@ -48,57 +106,241 @@ public:
     void		restart();
     void        start();
     void		stop();
-    void		connect(unsigned int connection_index);
 
     void		ingest(Reading& reading);
+    void		ingest(std::vector<Reading *>* readings, uint64_t received_ns = 0);
     void		registerIngest(void *data, void (*cb)(void *, Reading));
+    void		registerIngestV2(void *data, void (*cb)(void *, std::vector<Reading *>*));
     bool        operation(const std::string& operation, int count, PLUGIN_PARAMETER **params);
 
+    // Failovers of the active path, and their latency from the loss of the path to the first reading of the new path ingested
+    uint64_t    failovers() const { return m_failovers; }
+    uint64_t    lastFailoverLatency() const { return m_last_failover_latency_ms; }
+    uint64_t    maxFailoverLatency() const { return m_max_failover_latency_ms; }
+
+    // Feed the monitoring ASDUs received in a capture file to the decoder of the started instance,
+    // without any socket : as fast as possible when speed is 0, else speed times faster than captured.
+    // Returns the number of ASDUs replayed.
+    uint64_t    replay(const std::string& capture_file, double speed);
 
-private:
-    template <class T>
-    static T m_getConfigValue(nlohmann::json configuration, nlohmann::json_pointer<nlohmann::json> path);
 
+private:
+    // Scheduler tasks
+    void m_connectPath(unsigned int path_index);
+    void m_onPathOpened(CS104_Connection connection);
+    void m_onPathClosed(CS104_Connection connection, const std::string& reason);
+    void m_onStartDTConfirmed(CS104_Connection connection);
+    void m_startPath(unsigned int path_index);
+    void m_electActivePath();
+    void m_requeueCommandsInFlight();
+    void m_onIngest(uint64_t received_ns);
+    void m_sendStatistics();
+    Reading* m_createStatisticsReading();
+    void m_checkStartup();
+    void m_logStartupTimings();
     void m_sendInterrogationCommmands();
-    void m_sendInterrogationCommmandToCA(unsigned int ca, int gi_repeat_count, int gi_time);
+    void m_sendGroupInterrogation(unsigned int ca, int group);
 	void m_sendTestCommmands();
+    void m_queueCommand(IEC104Command::Kind kind, unsigned int ca, int qoi);
+    void m_pumpCommands();
+    void m_sendCommand(IEC104Command& command);
+    void m_onCommandTimeout(unsigned int ca, uint64_t sequence);
+    void m_onCommandResponse(int type_id, unsigned int ca, int qoi, int cot, bool negative);
+    void m_finishCommand(std::unordered_map<unsigned int, IEC104Command>::iterator it, bool success);
+    void m_completeInterrogationRound();
+
+    void m_onBroadcastResponse(unsigned int ca, int cot, bool negative);
+    void m_finishBroadcast(bool success);
+
+    // Station GIs are the ones counted in a GI round
+    bool m_isRoundCommand(const IEC104Command& command) const
+    { return command.kind == IEC104Command::INTERROGATION && command.qoi == IEC60870_QOI_STATION; }
+
+    bool m_isBroadcast(const IEC104Command& command) const
+    { return command.ca == (unsigned int) m_active_config->getBroadcastCA(); }
+
+    bool m_sendInterrogationCommmandToCA(unsigned int ca, int qoi);
+    bool m_sendTestCommandToCA(unsigned int ca);
+    CS104_Connection m_createConnection(unsigned int path_index);
+    void m_configureConnection(CS104_Connection connection);
+    sCS101_AppLayerParameters m_getAppLayerParameters() const;
+    uint64_t m_getBackoffDelay(unsigned int failures);
+    int m_getPathIndex(CS104_Connection connection) const;
+    void m_setPathState(IEC104Path& path, IEC104PathState state);
 	
-	static std::string m_checkExchangedDataLayer(unsigned int ca, const std::string& type_id, unsigned int ioa);
+    typedef void (*DecodeFunction)(IEC104Client* client, const IEC104Config& config, CS101_ASDU asdu,
+                                   IEC104ElementReader& reader);
 
-    static CS104_Connection m_createTlsConnection(const char* ip, int port);
+    template <int TYPE_ID>
+    static void m_decodeElements(IEC104Client* client, const IEC104Config& config, CS101_ASDU asdu,
+                                 IEC104ElementReader& reader);
+    static const DecodeFunction* m_getDecoders();
 
-	static int m_watchdog(int delay, int checkRes, bool *flag, std::string id);
+	static const IEC104DataPoint* m_checkExchangedDataLayer(const IEC104Config& config, unsigned int ca, int type_id, unsigned int ioa);
 
-    static int m_getBroadcastCA() ;
+    TLSConfiguration m_createTlsConfiguration();
+    CS104_Connection m_createTlsConnection(const char* ip, int port);
 
     static void m_connectionHandler (void* parameter, CS104_Connection connection, CS104_ConnectionEvent event);
     static bool m_asduReceivedHandler (void* parameter, int address, CS101_ASDU asdu);
 
-    bool m_startup_done;
-
-    static nlohmann::json m_stack_configuration;
-    static nlohmann::json m_msg_configuration;
-    static nlohmann::json m_pivot_configuration;
-    static nlohmann::json m_tls_configuration;
+    // Timed tasks, all run on the scheduler thread, as is every access to the members below but m_client
+    IEC104Scheduler     m_scheduler;
+
+    bool                m_startup_done = false;
+    uint64_t            m_start_time_ms = 0;
+
+    // Written by the scheduler thread, and by start() and stop() while it is stopped. Readers
+    // from other threads take m_paths_mutex, which writers hold when replacing a connection or
+    // changing its started flag.
+    std::vector<IEC104Path> m_paths;
+    std::mutex              m_paths_mutex;
+    std::minstd_rand        m_random{std::random_device()()};   // Backoff jitter
+    int                     m_active_path = -1;     // Path elected to receive data, -1 if none
+
+    // Certificates of the TLS connections, shared by every path and kept across reconnections
+    TLSConfiguration        m_tls_config = nullptr;
+
+    // Raw APDUs of every path, when capture_file is set. Replaced under m_paths_mutex.
+    std::unique_ptr<IEC104Capture> m_capture;
+
+    // Replay started by the replay operation, stopped by stop()
+    std::thread             m_replay_thread;
+    std::atomic<bool>       m_replay_running{false};
+    std::atomic<bool>       m_replay_stop{false};
+
+    // Set by the scheduler thread when the active path is lost, cleared by the first ingest of an ASDU received after it
+    std::atomic<uint64_t>   m_failover_start_ms{0};
+    std::atomic<uint64_t>   m_failovers{0};
+    std::atomic<uint64_t>   m_last_failover_latency_ms{0};
+    std::atomic<uint64_t>   m_max_failover_latency_ms{0};
+
+    // Commands waiting to be sent, and at most one command waiting for its answer per CA
+    std::deque<IEC104Command>                           m_command_queue;
+    std::unordered_map<unsigned int, IEC104Command>     m_commands_in_flight;   // By CA
+    IEC104Scheduler::TimerId m_pump_timer = 0;
+    uint64_t            m_next_command_ms = 0;  // Commands are gi_pacing ms apart
+    uint16_t            m_test_sequence = 0;    // Test sequence counter of C_TS_TA_1
+    uint64_t            m_command_sequence = 0; // Tells the timeout of an attempt from the ones of earlier commands
+
+    // GI round : every CA is interrogated once, gi_max_concurrent at a time
+    bool                m_gi_in_progress = false;
+    unsigned int        m_gi_round_pending = 0;     // CAs of the round whose station GI is not finished yet
+    std::unordered_set<unsigned int> m_broadcast_pending;   // CAs that did not terminate the broadcast GI in flight
+    std::unordered_map<unsigned int, uint64_t>          m_gi_durations;     // Last measured GI duration of each CA, in ms
+    uint64_t            m_gi_round_start_ms = 0;
+    unsigned int        m_gi_round_done = 0;
+    unsigned int        m_gi_round_failed = 0;
+    uint64_t            m_gi_complete_ms = 0;   // End of the first GI round since start()
+    IEC104Scheduler::TimerId m_gi_cycle_timer = 0;
+
+    // Last configuration loaded by setJsonConfig, and the snapshot the running instance was started with
+    static std::shared_ptr<const IEC104Config> m_config;
+    std::shared_ptr<const IEC104Config> m_active_config;
 
     std::string	m_asset;
 
-    static bool	        m_comm_wttag;
-	static std::string	m_tsiv;
-    std::vector<CS104_Connection>    m_connections;
 
-    INGEST_CB			m_ingest;     // Callback function used to send data to south service
+    INGEST_CB			m_ingest = nullptr;     // Callback function used to send data to south service
+    INGEST_CB2			m_ingest_v2 = nullptr;  // Callback function used to send batches of readings, when the service supports it
     void*               m_data;       // Ingest function data
     IEC104Client*       m_client;
 };
 
+/**
+ * Information object decoded by a lib60870 receive thread, waiting in the ingest
+ * queue to be turned into a pivot Reading by the ingest worker.
+ */
+struct IEC104DataRecord
+{
+    // ASDU header
+    uint32_t        asdu_id;        // Same for all the records decoded from one ASDU
+    uint16_t        ca;
+    uint8_t         oa;
+    uint8_t         type_id;
+    uint8_t         cot;
+    bool            is_test;
+    bool            is_negative;
+
+    // Information object
+    bool            is_float;
+    bool            has_timestamp;
+    uint8_t         quality;
+    uint32_t        point_id;
+    uint32_t        ioa;
+    union
+    {
+        int64_t     integer;
+        double      real;
+    }               value;
+    sCP56Time2a     timestamp;
+    uint64_t        received_ns;    // IEC104LatencyStats::nowNs() when the ASDU was received
+
+    void setValue(long v) { value.integer = v; is_float = false; }
+    void setValue(float v) { value.real = v; is_float = true; }
+};
+
 class IEC104Client
 {
+    friend class IEC104Bench;
+
 public :
-    explicit IEC104Client(IEC104 *iec104, nlohmann::json* pivot_configuration) :
-        m_iec104(iec104),
-        m_pivot_configuration(pivot_configuration)
-        {};
+    explicit IEC104Client(IEC104 *iec104, std::shared_ptr<const IEC104Config> config);
+    ~IEC104Client();
+
+    const IEC104Config& config() const { return *m_config; }
+    IEC104* iec104() const { return m_iec104; }
+
+    // Start the ingest worker thread, and stop it once the queue is drained
+    void startWorker();
+    void stopWorker();
+
+    // ==================================================================== //
+    // Called by the lib60870 receive threads
+
+    // Fill the ASDU header of record, and give it the id of a new ASDU
+    void initRecord(IEC104DataRecord& record, CS101_ASDU asdu);
+
+    // Queue a decoded information object for ingestion. Waits while the queue is full.
+    void push(const IEC104DataRecord& record)
+    {
+        if (!m_queue.tryPush(record))
+            m_pushWhenFull(record);
+    }
+
+    // Called after the last record of an ASDU has been pushed : wakes up the ingest worker
+    void flush();
+
+    // Deadband and unchanged value suppression : false when the value of record must not be forwarded
+    bool filter(const IEC104DataPoint& point, const IEC104DataRecord& record)
+    {
+        return m_filter.accept(point, record.is_float ? record.value.real : (double) record.value.integer,
+                               record.quality, record.cot);
+    }
+    // ==================================================================== //
+
+    // Decode stage counters : elements read from ASDUs, and how many of them needed a heap allocation
+    void countDecodedElements(uint64_t elements, uint64_t heap_elements)
+    {
+        m_decoded_elements.fetch_add(elements, std::memory_order_relaxed);
+        m_heap_decoded_elements.fetch_add(heap_elements, std::memory_order_relaxed);
+    }
+    uint64_t decodedElements() const { return m_decoded_elements.load(std::memory_order_relaxed); }
+    uint64_t heapDecodedElements() const { return m_heap_decoded_elements.load(std::memory_order_relaxed); }
+
+    // Ingest queue counters
+    size_t queueDepth() const { return m_queue.size(); }
+    size_t queueCapacity() const { return m_queue.capacity(); }
+    size_t queueHighWaterMark() const { return m_queue_high_water_mark.load(std::memory_order_relaxed); }
+    uint64_t queueFullWaits() const { return m_queue_full_waits.load(std::memory_order_relaxed); }
+
+    // Filter counters
+    uint64_t forwardedValues() const { return m_filter.forwarded(); }
+    uint64_t suppressedValues() const { return m_filter.suppressed(); }
+    uint64_t suppressedUnchangedValues() const { return m_filter.suppressedUnchanged(); }
+
+    // Latency of each stage from ASDU reception to ingest
+    IEC104LatencyStats& latency() { return m_latency; }
 
     // ==================================================================== //
     // Note : The overloaded method addData is used to prevent the user from
@@ -116,10 +358,14 @@ public :
     { m_addData(datapoints, ioa, dataname, value, qd, ts); }
     // ==================================================================== //
 
-    // Sends the datapoints passed as Reading to Fledge
-    void sendData(CS101_ASDU asdu, std::vector<Datapoint*> data, const std::string& dataName);
+    // Sends the records passed as Readings to Fledge, in a single ingest call
+    void sendData(const IEC104DataRecord* records, size_t count);
 
 private:
+    void m_pushWhenFull(const IEC104DataRecord& record);
+    void m_ingestWorker();
+    Datapoint* m_createHeader(const IEC104DataRecord& record);
+
     template <class T>
     void m_addData(std::vector<Datapoint *> &datapoints, long ioa,
                           const std::string& dataname, const T value,
@@ -132,33 +378,46 @@ private:
         return new Datapoint(dataname,dp_value);
     }
 
-    // Format 2019-01-01 10:00:00.123456+08:00
-    static std::string CP56Time2aToString(const CP56Time2a ts)
+    // Format 2019-01-01 10:00:00.123
+    std::string m_timeToString(const CP56Time2a ts)
     {
-        if (ts == nullptr)
-            return "";
-
-        return std::to_string(CP56Time2a_getYear(ts) + 2000) + "-" +
-               std::to_string(CP56Time2a_getMonth(ts)) + "-" +
-               std::to_string(CP56Time2a_getDayOfMonth (ts)) + " " +
-               std::to_string(CP56Time2a_getHour(ts)) + ":" +
-               std::to_string(CP56Time2a_getMinute(ts)) + ":" +
-               std::to_string(CP56Time2a_getSecond(ts)) + "." +
-               millisecondsToString(CP56Time2a_getMillisecond(ts));
+        char buffer[IEC104TimeFormatter::LENGTH];
+        return std::string(buffer, m_time_formatter.format(ts, buffer));
     }
 
-    static std::string millisecondsToString(int ms)
-    {
-        if (ms < 10)
-            return "00" + std::to_string(ms);
-        else if (ms < 100)
-            return "0" + std::to_string(ms);
-        else
-            return std::to_string(ms);
-    }
+    // The time tag is in UTC when utc_time is set, in the local time of the host otherwise
+    int64_t m_timeToEpochMs(const CP56Time2a ts)
+    { return m_time_formatter.toEpochMs(ts, m_config->application.utc_time); }
+
+    Datapoint* m_createTimeMarker(const std::string& dataname, const CP56Time2a ts);
 
     IEC104* m_iec104;
-    nlohmann::json* m_pivot_configuration;
+    std::shared_ptr<const IEC104Config> m_config;
+    IEC104PointFilter m_filter;
+
+    IEC104RingBuffer<IEC104DataRecord>  m_queue;
+    std::thread                         m_worker;
+    std::atomic<bool>                   m_worker_running{false};
+    std::atomic<bool>                   m_worker_waiting{false};
+    std::mutex                          m_worker_mutex;
+    std::condition_variable             m_worker_cv;
+
+    // Receive threads blocked on a full queue, woken by the worker once it took a batch
+    std::atomic<unsigned int>           m_producers_waiting{0};
+    std::mutex                          m_space_mutex;
+    std::condition_variable             m_space_cv;
+
+    std::atomic<uint32_t>   m_next_asdu_id{0};
+    std::atomic<size_t>     m_queue_high_water_mark{0};
+    std::atomic<uint64_t>   m_queue_full_waits{0};
+
+    // Only used by the ingest worker
+    IEC104TimeFormatter     m_time_formatter;
+
+    std::atomic<uint64_t> m_decoded_elements{0};
+    std::atomic<uint64_t> m_heap_decoded_elements{0};
+
+    IEC104LatencyStats      m_latency;
 };
 
 #endif
@@ -0,0 +1,134 @@
+#ifndef _IEC104_CAPTURE_H
+#define _IEC104_CAPTURE_H
+
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/** Start of a capture file, followed by the ring of records */
+struct IEC104CaptureHeader
+{
+    static const uint32_t VERSION = 1;
+
+    char                    magic[8];           // "IEC104CP"
+    uint32_t                version;
+    uint32_t                header_size;        // Offset of the ring in the file
+    uint64_t                capacity;           // Size of the ring in bytes, a multiple of 8
+    uint64_t                start_steady_ns;    // Steady clock, and wall clock, when the file was created
+    uint64_t                start_epoch_ns;
+    std::atomic<uint64_t>   head;               // Bytes reserved in the ring since the file was created
+};
+
+/**
+ * Record of one APDU, 8 bytes aligned, followed by the APDU bytes. A record never
+ * wraps around the end of the ring : the space left before the end is then filled
+ * with a PADDING record, or skipped when it is too short for one.
+ */
+struct IEC104CaptureRecord
+{
+    enum Direction : uint8_t { RECEIVED, SENT, PADDING };
+
+    uint64_t    position;       // Position of the record since the file was created, written last
+    uint64_t    timestamp_ns;   // Steady clock
+    uint32_t    size;           // Record size, header and padding included
+    uint16_t    length;         // APDU bytes
+    uint8_t     path;           // Index of the path in protocol_stack
+    uint8_t     direction;
+};
+
+/**
+ * Capture of the raw APDUs received and sent on each path, to a memory-mapped ring
+ * file of fixed size : the file holds the last APDUs, and survives a crash of the
+ * process. Writers reserve their record with a compare-and-swap on the head of the
+ * ring, then copy the APDU : they never block nor call into the kernel. Readers
+ * check that the position of a record matches its place in the ring, which tells
+ * complete records from the ones overwritten or still being written.
+ */
+class IEC104Capture
+{
+public:
+    /** Raw message handler parameter of a path */
+    struct Source
+    {
+        IEC104Capture*  capture;
+        uint8_t         path;
+    };
+
+    IEC104Capture() = default;
+    ~IEC104Capture();
+
+    IEC104Capture(const IEC104Capture&) = delete;
+    IEC104Capture& operator=(const IEC104Capture&) = delete;
+
+    /** Create or truncate file, with a ring of size bytes, for paths paths. Returns false on error, logged. */
+    bool open(const std::string& file, size_t size, unsigned int paths);
+
+    void setEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    /** Append an APDU of a path to the ring, unless capture is disabled */
+    void write(uint8_t path, bool sent, const uint8_t* apdu, int length)
+    {
+        if (m_enabled.load(std::memory_order_relaxed))
+            m_write(path, sent ? IEC104CaptureRecord::SENT : IEC104CaptureRecord::RECEIVED, apdu, length);
+    }
+
+    Source* getSource(unsigned int path) { return &m_sources[path]; }
+
+    uint64_t capturedBytes() const { return m_header ? m_header->head.load(std::memory_order_relaxed) : 0; }
+
+    /** lib60870 raw message handler, parameter being the Source of the connection */
+    static void rawMessageHandler(void* parameter, uint8_t* msg, int msgSize, bool sent);
+
+private:
+    void m_write(uint8_t path, IEC104CaptureRecord::Direction direction, const uint8_t* apdu, int length);
+
+    std::atomic<bool>       m_enabled{false};
+    IEC104CaptureHeader*    m_header = nullptr;
+    uint8_t*                m_ring = nullptr;
+    size_t                  m_mapped_size = 0;
+    std::vector<Source>     m_sources;
+};
+
+/**
+ * Reader of a capture file, oldest record first. The records are the ones complete
+ * when the file was opened : the capture may go on meanwhile, as long as it does not
+ * overwrite the records not read yet.
+ */
+class IEC104CaptureReader
+{
+public:
+    IEC104CaptureReader() = default;
+    ~IEC104CaptureReader();
+
+    IEC104CaptureReader(const IEC104CaptureReader&) = delete;
+    IEC104CaptureReader& operator=(const IEC104CaptureReader&) = delete;
+
+    /** Map file read only. Returns false on error, logged. */
+    bool open(const std::string& file);
+
+    /** Next APDU record, false at the end of the capture */
+    bool next(const IEC104CaptureRecord*& record, const uint8_t*& apdu);
+
+private:
+    const IEC104CaptureHeader*  m_header = nullptr;
+    const uint8_t*              m_ring = nullptr;
+    size_t                      m_mapped_size = 0;
+    uint64_t                    m_position = 0;
+    uint64_t                    m_end = 0;
+};
+
+#endif
@@ -0,0 +1,240 @@
+#ifndef _IEC104_CONFIG_H
+#define _IEC104_CONFIG_H
+
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+
+/** Raised by IEC104Config::parse when the configuration is not usable */
+class IEC104ConfigError : public std::runtime_error
+{
+public:
+    explicit IEC104ConfigError(const std::string& what) : std::runtime_error(what) {}
+};
+
+enum class IEC104DeadbandMode
+{
+    NONE,
+    ABSOLUTE,   // Forward when the value moved by more than threshold since the last forwarded one
+    PERCENT,    // Same as ABSOLUTE, threshold being resolved from a percentage of the range of the point
+    INTEGRAL    // Forward when the deviation from the last forwarded value, integrated over time, exceeds threshold
+};
+
+struct IEC104Deadband
+{
+    IEC104DeadbandMode  mode;
+    double              threshold;  // In units of the value, or units x seconds for INTEGRAL
+};
+
+/**
+ * Information object known from the exchanged_data configuration.
+ * Entries are compiled once by setJsonConfig and looked up by (CA, TypeID, IOA).
+ */
+struct IEC104DataPoint
+{
+    std::string     label;
+    unsigned int    id;         // Dense index of the point in the configuration, in [0, number of points)
+    unsigned int    ca;
+    int             type_id;
+    unsigned int    ioa;
+    IEC104Deadband  deadband;   // Only for measured values
+};
+
+struct IEC104PathConfig
+{
+    std::string     srv_ip;
+    std::string     clt_ip;
+    int             port;
+};
+
+struct IEC104TransportConfig
+{
+    std::vector<IEC104PathConfig> paths;
+    bool            tls;
+    int             llevel;
+    int             k_value;
+    int             w_value;
+    int             t0_timeout;
+    int             t1_timeout;
+    int             t2_timeout;
+    int             t3_timeout;
+    bool            conn_all;
+    bool            start_all;
+    bool            conn_passv;
+    int             reconnect_delay_min;    // ms, first delay before reconnecting a failed path
+    int             reconnect_delay_max;    // ms, the delay doubles on each failure up to this value
+    std::string     capture_file;           // Raw APDU capture ring file, empty for no capture
+    int             capture_size;           // MB
+    bool            capture_enabled;        // Initial state of the capture, switched by the capture operation
+};
+
+/** Group interrogation (QOI 21 to 36) of a CA, sent every period seconds */
+struct IEC104GroupInterrogation
+{
+    unsigned int    ca;
+    int             group;      // 1 to 16
+    int             period;
+};
+
+struct IEC104ApplicationConfig
+{
+    int             orig_addr;
+    int             ca_asdu_size;
+    int             ioaddr_size;
+    int             startup_time;
+    int             asdu_size;      // 0 in the configuration is resolved to 249, the IEC 104 maximum
+    int             gi_time;
+    bool            gi_cycle;
+    bool            gi_all_ca;
+    int             gi_repeat_count;
+    int             gi_max_concurrent;  // GIs of different CAs waiting for their ACTTERM at the same time
+    int             gi_pacing;      // ms, minimum delay between two interrogation or test commands
+    std::vector<IEC104GroupInterrogation> gi_groups;
+    bool            tsiv_process;   // tsiv == "PROCESS" : keep values whose time tag is invalid
+    bool            utc_time;
+    bool            comm_wttag;
+    bool            exec_cycl_test;
+    bool            startup_state;
+    bool            time_sync;
+    int             ingest_queue_size;  // Decoded information objects buffered between the receive threads and the ingest worker
+    unsigned int    suppress_unchanged; // IEC104CotClass mask : drop values equal to the last forwarded one for these COTs
+    int             unchanged_refresh;  // Minutes after which an unchanged value is forwarded anyway, 0 for never
+    int             stats_period;   // Seconds between two latency statistics Readings, 0 for none
+    bool            latency_stats;  // Record the stage latency histograms, at the cost of clock reads per element
+};
+
+/** Classes of cause of transmission, as bits of IEC104ApplicationConfig::suppress_unchanged */
+enum IEC104CotClass : unsigned int
+{
+    IEC104_COT_CLASS_NONE           = 0,
+    IEC104_COT_CLASS_SPONTANEOUS    = 1 << 0,
+    IEC104_COT_CLASS_BACKGROUND     = 1 << 1,
+    IEC104_COT_CLASS_INTERROGATED   = 1 << 2,   // Station, group and counter interrogations
+    IEC104_COT_CLASS_PERIODIC       = 1 << 3
+};
+
+struct IEC104TlsConfig
+{
+    // Absolute paths, resolved against $FLEDGE_ROOT/data/etc/certs
+    std::string     private_key;
+    std::string     server_cert;
+    std::string     ca_cert;
+};
+
+/** IEC 104 fields that can be mapped to the pivot format */
+enum class IEC104PivotField
+{
+    // data_object_header fields
+    TYPE_ID,
+    CA,
+    OA,
+    COT,
+    IS_TEST,
+    IS_NEGATIVE,
+    // data_object_item fields
+    IOA,
+    VALUE,
+    QUALITY_DESC,
+    TIME_MARKER,
+    IS_INVALID,
+    IS_SUMMER_TIME,
+    IS_SUBSTITUTED
+};
+
+/** One compiled mapping entry : emit field under the pivot name key */
+struct IEC104PivotOp
+{
+    IEC104PivotField    field;
+    std::string         key;
+};
+
+/** How the time_marker field is emitted */
+enum class IEC104TimeMarkerFormat
+{
+    STRING,     // "YYYY-MM-DD HH:MM:SS.mmm"
+    EPOCH_MS,   // Milliseconds since the Unix epoch, as an integer
+    EPOCH_US    // Microseconds since the Unix epoch, as an integer
+};
+
+struct IEC104PivotConfig
+{
+    // Ops in the order they are emitted, which is the key order of the json mapping
+    std::vector<IEC104PivotOp> data_object_header;
+    std::vector<IEC104PivotOp> data_object_item;
+    IEC104TimeMarkerFormat     time_marker_format;
+};
+
+/**
+ * Typed and validated view of the four json configuration strings of the plugin.
+ * A snapshot is built once by setJsonConfig and never modified afterwards, so it
+ * can be read by any thread without locking and without any json access.
+ */
+class IEC104Config
+{
+public:
+    static std::shared_ptr<const IEC104Config> parse(const std::string& stack_configuration,
+                                                     const std::string& msg_configuration,
+                                                     const std::string& pivot_configuration,
+                                                     const std::string& tls_configuration);
+
+    const IEC104DataPoint* findPoint(unsigned int ca, int type_id, unsigned int ioa) const
+    {
+        auto it = point_index.find(getPointKey(ca, type_id, ioa));
+        return it != point_index.end() ? &points[it->second] : nullptr;
+    }
+
+    bool isKnownCA(unsigned int ca) const
+    { return known_cas.find(ca) != known_cas.end(); }
+
+    bool isKnownTypeId(unsigned int ca, int type_id) const
+    { return known_type_ids.find(getPointKey(ca, type_id, 0)) != known_type_ids.end(); }
+
+    // Broadcast address is the maximum value possible, ie 2^(8*asdu_size) - 1
+    int getBroadcastCA() const
+    { return (1 << (8 * application.ca_asdu_size)) - 1; }
+
+    static int getTypeIdFromString(const std::string& type_id);
+    static IEC104CotClass getCotClass(int cot);
+
+    // Points are indexed by (CA << 32) | (TypeID << 24) | IOA, IOA being at most 3 bytes long
+    static uint64_t getPointKey(unsigned int ca, int type_id, unsigned int ioa)
+    { return ((uint64_t) ca << 32) | ((uint64_t) (type_id & 0xff) << 24) | (ioa & 0xffffff); }
+
+    IEC104TransportConfig       transport;
+    IEC104ApplicationConfig     application;
+    IEC104TlsConfig             tls;
+    IEC104PivotConfig           pivot;
+
+    std::vector<IEC104DataPoint>            points;         // Indexed by point id
+    std::vector<unsigned int>               cas;            // Distinct CAs of the points, in configuration order
+
+private:
+    IEC104Config() = default;
+
+    void m_parseStack(const std::string& stack_configuration);
+    void m_parseExchangedData(const std::string& msg_configuration);
+    void m_parsePivot(const std::string& pivot_configuration);
+    void m_parseTls(const std::string& tls_configuration);
+
+    std::unordered_map<uint64_t, unsigned int>  point_index;
+    std::unordered_set<unsigned int>            known_cas;
+    std::unordered_set<uint64_t>                known_type_ids;
+};
+
+#endif
@@ -0,0 +1,270 @@
+#ifndef _IEC104_DECODER_H
+#define _IEC104_DECODER_H
+
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <lib60870/hal_time.h>
+#include <lib60870/cs104_connection.h>
+#include <cstdint>
+#include <ctime>
+
+
+/**
+ * Storage for one information object. lib60870 does not publish the size of its
+ * information object structures, so like sCS101_StaticASDU the buffer is sized
+ * to hold the largest of them.
+ */
+union IEC104ElementBuffer
+{
+    uint8_t     raw[256];
+    uint64_t    align_integer;
+    double      align_float;
+    void*       align_pointer;
+};
+
+/**
+ * Reads the elements of an ASDU one at a time with CS101_ASDU_getElementEx into a
+ * buffer owned by the calling thread, so that decoding does not allocate.
+ * An element stays valid until the next call to get().
+ */
+class IEC104ElementReader
+{
+public:
+    explicit IEC104ElementReader(CS101_ASDU asdu) : m_asdu(asdu) {}
+    ~IEC104ElementReader() { m_release(); }
+
+    InformationObject get(int index)
+    {
+        m_release();
+        m_io = CS101_ASDU_getElementEx(m_asdu, (InformationObject) &m_buffer(), index);
+
+        if (m_io != nullptr)
+        {
+            m_elements++;
+            // lib60870 only allocates when it could not use the buffer it was given
+            if ((void*) m_io != (void*) &m_buffer())
+                m_heap_elements++;
+        }
+        return m_io;
+    }
+
+    uint64_t elements() const { return m_elements; }
+    uint64_t heapElements() const { return m_heap_elements; }
+
+private:
+    // One buffer per lib60870 connection thread, reused for every element it decodes
+    static IEC104ElementBuffer& m_buffer()
+    {
+        static thread_local IEC104ElementBuffer buffer;
+        return buffer;
+    }
+
+    void m_release()
+    {
+        if (m_io != nullptr && (void*) m_io != (void*) &m_buffer())
+            InformationObject_destroy(m_io);
+        m_io = nullptr;
+    }
+
+    CS101_ASDU          m_asdu;
+    InformationObject   m_io = nullptr;
+    uint64_t            m_elements = 0;
+    uint64_t            m_heap_elements = 0;
+};
+
+
+// ==================================================================== //
+// Value and quality access for each family of monitoring information
+// objects. The time tagged variants of a family share its accessors.
+
+struct IEC104SinglePointAccess
+{
+    typedef long Value;
+    static Value value(InformationObject io) { return SinglePointInformation_getValue((SinglePointInformation) io); }
+    static QualityDescriptor quality(InformationObject io) { return SinglePointInformation_getQuality((SinglePointInformation) io); }
+};
+
+struct IEC104DoublePointAccess
+{
+    typedef long Value;
+    static Value value(InformationObject io) { return DoublePointInformation_getValue((DoublePointInformation) io); }
+    static QualityDescriptor quality(InformationObject io) { return DoublePointInformation_getQuality((DoublePointInformation) io); }
+};
+
+struct IEC104StepPositionAccess
+{
+    typedef long Value;
+    static Value value(InformationObject io) { return StepPositionInformation_getValue((StepPositionInformation) io); }
+    static QualityDescriptor quality(InformationObject io) { return StepPositionInformation_getQuality((StepPositionInformation) io); }
+};
+
+struct IEC104BitString32Access
+{
+    typedef long Value;
+    static Value value(InformationObject io) { return BitString32_getValue((BitString32) io); }
+    static QualityDescriptor quality(InformationObject io) { return BitString32_getQuality((BitString32) io); }
+};
+
+struct IEC104NormalizedAccess
+{
+    typedef float Value;
+    static Value value(InformationObject io) { return MeasuredValueNormalized_getValue((MeasuredValueNormalized) io); }
+    static QualityDescriptor quality(InformationObject io) { return MeasuredValueNormalized_getQuality((MeasuredValueNormalized) io); }
+};
+
+struct IEC104ScaledAccess
+{
+    typedef long Value;
+    static Value value(InformationObject io) { return MeasuredValueScaled_getValue((MeasuredValueScaled) io); }
+    static QualityDescriptor quality(InformationObject io) { return MeasuredValueScaled_getQuality((MeasuredValueScaled) io); }
+};
+
+struct IEC104ShortAccess
+{
+    typedef float Value;
+    static Value value(InformationObject io) { return MeasuredValueShort_getValue((MeasuredValueShort) io); }
+    static QualityDescriptor quality(InformationObject io) { return MeasuredValueShort_getQuality((MeasuredValueShort) io); }
+};
+
+struct IEC104IntegratedTotalsAccess
+{
+    typedef long Value;
+    static Value value(InformationObject io)
+    { return BinaryCounterReading_getValue(IntegratedTotals_getBCR((IntegratedTotals) io)); }
+
+    // The IV, CA and CY flags of a binary counter reading use the same bits as IV, NT and SB in a quality descriptor
+    static QualityDescriptor quality(InformationObject io)
+    {
+        BinaryCounterReading bcr = IntegratedTotals_getBCR((IntegratedTotals) io);
+        return (BinaryCounterReading_isInvalid(bcr) ? 0x80 : 0)
+             | (BinaryCounterReading_isAdjusted(bcr) ? 0x40 : 0)
+             | (BinaryCounterReading_hasCarry(bcr) ? 0x20 : 0);
+    }
+};
+
+
+// ==================================================================== //
+// Time tag of a type, always returned as a CP56Time2a, in UTC when utc is set and
+// in the local time of the host otherwise (utc_time)
+
+enum class IEC104TimeKind { None, CP24, CP56 };
+
+struct IEC104NoTimeTag
+{
+    static const IEC104TimeKind time_kind = IEC104TimeKind::None;
+    static bool timestamp(InformationObject, sCP56Time2a&, bool) { return false; }
+};
+
+template <class Object, CP56Time2a (*GET_TIMESTAMP)(Object)>
+struct IEC104CP56TimeTag
+{
+    static const IEC104TimeKind time_kind = IEC104TimeKind::CP56;
+    static bool timestamp(InformationObject io, sCP56Time2a& ts, bool)
+    {
+        ts = *GET_TIMESTAMP((Object) io);
+        return true;
+    }
+};
+
+/** Offset of the local time of the host from UTC at epoch_ms, in ms, and whether it is summer time. Cached for the minute. */
+inline int64_t IEC104LocalOffsetMs(uint64_t epoch_ms, bool& summer_time)
+{
+    static thread_local uint64_t minute = 0;
+    static thread_local int64_t offset_ms = 0;
+    static thread_local bool summer = false;
+
+    if (epoch_ms / 60000 != minute)
+    {
+        time_t seconds = epoch_ms / 1000;
+        struct tm local;
+        localtime_r(&seconds, &local);
+        offset_ms = (int64_t) local.tm_gmtoff * 1000;
+        summer = local.tm_isdst > 0;
+        minute = epoch_ms / 60000;
+    }
+    summer_time = summer;
+    return offset_ms;
+}
+
+/**
+ * CP24Time2a only carries minutes, seconds and milliseconds : the rest of the date is
+ * taken from the clock of the host, in the time base of the time tag. The hour is the
+ * one that puts the time tag closest to the clock, at most 30 minutes away from it.
+ */
+template <class Object, CP24Time2a (*GET_TIMESTAMP)(Object)>
+struct IEC104CP24TimeTag
+{
+    static const IEC104TimeKind time_kind = IEC104TimeKind::CP24;
+    static bool timestamp(InformationObject io, sCP56Time2a& ts, bool utc)
+    {
+        CP24Time2a cp24 = GET_TIMESTAMP((Object) io);
+
+        // CP56Time2a_createFromMsTimestamp fills the UTC fields : shifted by the offset, they are the local ones
+        uint64_t now = Hal_getTimeInMs();
+        bool summer_time = false;
+        int64_t clock = (int64_t) now + (utc ? 0 : IEC104LocalOffsetMs(now, summer_time));
+        int64_t in_hour = CP24Time2a_getMinute(cp24) * 60000 + CP24Time2a_getSecond(cp24) * 1000
+                        + CP24Time2a_getMillisecond(cp24);
+        int64_t time = clock - clock % 3600000 + in_hour;
+        if (time > clock + 1800000)
+            time -= 3600000;
+        else if (time <= clock - 1800000)
+            time += 3600000;
+
+        CP56Time2a_createFromMsTimestamp(&ts, time);
+        CP56Time2a_setSummerTime(&ts, summer_time);
+        CP56Time2a_setInvalid(&ts, CP24Time2a_isInvalid(cp24));
+        CP56Time2a_setSubstituted(&ts, CP24Time2a_isSubstituted(cp24));
+        return true;
+    }
+};
+
+
+// ==================================================================== //
+// Per TypeID traits : value getter, quality getter, value type, timestamp
+// getter and kind. Adding a monitoring type only takes a line here and
+// an entry in the decoder table of iec104.cpp.
+
+template <int TYPE_ID> struct IEC104TypeTraits;
+
+template <> struct IEC104TypeTraits<M_SP_NA_1> : IEC104SinglePointAccess, IEC104NoTimeTag {};
+template <> struct IEC104TypeTraits<M_SP_TA_1> : IEC104SinglePointAccess, IEC104CP24TimeTag<SinglePointWithCP24Time2a, SinglePointWithCP24Time2a_getTimestamp> {};
+template <> struct IEC104TypeTraits<M_SP_TB_1> : IEC104SinglePointAccess, IEC104CP56TimeTag<SinglePointWithCP56Time2a, SinglePointWithCP56Time2a_getTimestamp> {};
+
+template <> struct IEC104TypeTraits<M_DP_NA_1> : IEC104DoublePointAccess, IEC104NoTimeTag {};
+template <> struct IEC104TypeTraits<M_DP_TA_1> : IEC104DoublePointAccess, IEC104CP24TimeTag<DoublePointWithCP24Time2a, DoublePointWithCP24Time2a_getTimestamp> {};
+template <> struct IEC104TypeTraits<M_DP_TB_1> : IEC104DoublePointAccess, IEC104CP56TimeTag<DoublePointWithCP56Time2a, DoublePointWithCP56Time2a_getTimestamp> {};
+
+template <> struct IEC104TypeTraits<M_ST_NA_1> : IEC104StepPositionAccess, IEC104NoTimeTag {};
+template <> struct IEC104TypeTraits<M_ST_TA_1> : IEC104StepPositionAccess, IEC104CP24TimeTag<StepPositionWithCP24Time2a, StepPositionWithCP24Time2a_getTimestamp> {};
+template <> struct IEC104TypeTraits<M_ST_TB_1> : IEC104StepPositionAccess, IEC104CP56TimeTag<StepPositionWithCP56Time2a, StepPositionWithCP56Time2a_getTimestamp> {};
+
+template <> struct IEC104TypeTraits<M_BO_NA_1> : IEC104BitString32Access, IEC104NoTimeTag {};
+template <> struct IEC104TypeTraits<M_BO_TA_1> : IEC104BitString32Access, IEC104CP24TimeTag<Bitstring32WithCP24Time2a, Bitstring32WithCP24Time2a_getTimestamp> {};
+template <> struct IEC104TypeTraits<M_BO_TB_1> : IEC104BitString32Access, IEC104CP56TimeTag<Bitstring32WithCP56Time2a, Bitstring32WithCP56Time2a_getTimestamp> {};
+
+template <> struct IEC104TypeTraits<M_ME_NA_1> : IEC104NormalizedAccess, IEC104NoTimeTag {};
+template <> struct IEC104TypeTraits<M_ME_TA_1> : IEC104NormalizedAccess, IEC104CP24TimeTag<MeasuredValueNormalizedWithCP24Time2a, MeasuredValueNormalizedWithCP24Time2a_getTimestamp> {};
+template <> struct IEC104TypeTraits<M_ME_TD_1> : IEC104NormalizedAccess, IEC104CP56TimeTag<MeasuredValueNormalizedWithCP56Time2a, MeasuredValueNormalizedWithCP56Time2a_getTimestamp> {};
+
+template <> struct IEC104TypeTraits<M_ME_NB_1> : IEC104ScaledAccess, IEC104NoTimeTag {};
+template <> struct IEC104TypeTraits<M_ME_TB_1> : IEC104ScaledAccess, IEC104CP24TimeTag<MeasuredValueScaledWithCP24Time2a, MeasuredValueScaledWithCP24Time2a_getTimestamp> {};
+template <> struct IEC104TypeTraits<M_ME_TE_1> : IEC104ScaledAccess, IEC104CP56TimeTag<MeasuredValueScaledWithCP56Time2a, MeasuredValueScaledWithCP56Time2a_getTimestamp> {};
+
+template <> struct IEC104TypeTraits<M_ME_NC_1> : IEC104ShortAccess, IEC104NoTimeTag {};
+template <> struct IEC104TypeTraits<M_ME_TC_1> : IEC104ShortAccess, IEC104CP24TimeTag<MeasuredValueShortWithCP24Time2a, MeasuredValueShortWithCP24Time2a_getTimestamp> {};
+template <> struct IEC104TypeTraits<M_ME_TF_1> : IEC104ShortAccess, IEC104CP56TimeTag<MeasuredValueShortWithCP56Time2a, MeasuredValueShortWithCP56Time2a_getTimestamp> {};
+
+template <> struct IEC104TypeTraits<M_IT_NA_1> : IEC104IntegratedTotalsAccess, IEC104NoTimeTag {};
+template <> struct IEC104TypeTraits<M_IT_TA_1> : IEC104IntegratedTotalsAccess, IEC104CP24TimeTag<IntegratedTotalsWithCP24Time2a, IntegratedTotalsWithCP24Time2a_getTimestamp> {};
+template <> struct IEC104TypeTraits<M_IT_TB_1> : IEC104IntegratedTotalsAccess, IEC104CP56TimeTag<IntegratedTotalsWithCP56Time2a, IntegratedTotalsWithCP56Time2a_getTimestamp> {};
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef _IEC104_LATENCY_H
+#define _IEC104_LATENCY_H
+
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+
+/**
+ * Lock-free log-linear histogram of durations in ns (HDR histogram layout) : values
+ * below 16 have a bucket each, every power of two above is split in 16 buckets, so
+ * that a value is reported within 1/16 of itself. Values are capped at 2^40 ns.
+ */
+class IEC104Histogram
+{
+public:
+    static const int SUB_BUCKETS = 16;
+    static const int MAX_MAGNITUDE = 40;
+    static const int BUCKETS = (MAX_MAGNITUDE - 3) * SUB_BUCKETS;
+
+    void record(uint64_t value)
+    {
+        m_buckets[m_getIndex(value)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+    }
+
+    /** Smallest value that percentile (in [0, 100]) of the recorded values do not exceed, 0 if empty */
+    uint64_t percentile(double percentile) const;
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+    void reset();
+
+private:
+    static int m_getIndex(uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+            return (int) value;
+
+        int magnitude = 63 - __builtin_clzll(value);
+        if (magnitude >= MAX_MAGNITUDE)
+            return BUCKETS - 1;
+
+        return (magnitude - 3) * SUB_BUCKETS + (int) ((value >> (magnitude - 4)) & (SUB_BUCKETS - 1));
+    }
+
+    // Highest value of a bucket
+    static uint64_t m_getValue(int index);
+
+    std::array<std::atomic<uint64_t>, BUCKETS>  m_buckets{};
+    std::atomic<uint64_t>                       m_count{0};
+    std::atomic<uint64_t>                       m_max{0};
+};
+
+
+/** Stages of the receive-to-ingest pipeline */
+enum class IEC104LatencyStage
+{
+    DECODE,         // ASDU received to all its elements queued, per ASDU
+    LOOKUP,         // Label lookup of an element, sampled on the first element of each ASDU
+    QUEUE,          // ASDU received to its records taken by the ingest worker
+    PIVOT,          // Pivot Reading built from a record (m_addData and header)
+    SEND_DATA,      // All the Readings of a batch built, per batch
+    INGEST,         // Ingest callback of the south service, per batch
+    END_TO_END,     // ASDU received to its Readings handed to the south service
+    COUNT
+};
+
+
+/**
+ * Latency histograms of each pipeline stage, overall and per TypeID. Written by the
+ * receive threads and the ingest worker without locking, read by the statistics export.
+ * Histograms of a TypeID are only allocated once the TypeID is received.
+ */
+class IEC104LatencyStats
+{
+public:
+    static const int STAGES = (int) IEC104LatencyStage::COUNT;
+
+    struct Stages
+    {
+        IEC104Histogram stage[STAGES];
+    };
+
+    IEC104LatencyStats() = default;
+    ~IEC104LatencyStats();
+
+    IEC104LatencyStats(const IEC104LatencyStats&) = delete;
+    IEC104LatencyStats& operator=(const IEC104LatencyStats&) = delete;
+
+    static uint64_t nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void record(IEC104LatencyStage stage, uint64_t ns)
+    { m_all.stage[(int) stage].record(ns); }
+
+    void record(IEC104LatencyStage stage, int type_id, uint64_t ns)
+    {
+        m_all.stage[(int) stage].record(ns);
+        m_getTypeStages(type_id).stage[(int) stage].record(ns);
+    }
+
+    const Stages& all() const { return m_all; }
+
+    /** Histograms of type_id, nullptr when it was never received */
+    const Stages* byType(int type_id) const
+    { return m_by_type[type_id & 0xff].load(std::memory_order_acquire); }
+
+    void reset();
+
+    static const char* getStageName(int stage);
+
+private:
+    Stages& m_getTypeStages(int type_id)
+    {
+        Stages* stages = m_by_type[type_id & 0xff].load(std::memory_order_acquire);
+        return stages != nullptr ? *stages : m_allocateTypeStages(type_id);
+    }
+
+    Stages& m_allocateTypeStages(int type_id);
+
+    Stages                              m_all;
+    std::array<std::atomic<Stages*>, 256> m_by_type{};
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef _IEC104_POINT_FILTER_H
+#define _IEC104_POINT_FILTER_H
+
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <iec104_config.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+
+/**
+ * Decides, right after decode, whether a value is forwarded to Fledge or suppressed,
+ * so that suppressed values never reach the ingest queue. A value is suppressed by
+ * the deadband of its point, or when it is unchanged and its COT class is listed in
+ * suppress_unchanged. A point is forwarded again once unchanged_refresh has elapsed.
+ *
+ * The last forwarded value of each point is kept in a table indexed by point id.
+ * Decoding threads of several connections may filter the same point, each entry is
+ * guarded by its own spin flag.
+ */
+class IEC104PointFilter
+{
+public:
+    explicit IEC104PointFilter(const IEC104Config& config);
+
+    /** Return true when the value of point must be forwarded */
+    bool accept(const IEC104DataPoint& point, double value, uint8_t quality, int cot);
+
+    uint64_t forwarded() const { return m_forwarded.load(std::memory_order_relaxed); }
+    uint64_t suppressed() const { return m_suppressed.load(std::memory_order_relaxed); }
+    uint64_t suppressedUnchanged() const { return m_suppressed_unchanged.load(std::memory_order_relaxed); }
+
+private:
+    struct PointState
+    {
+        std::atomic<bool>   busy{false};
+        bool                reported = false;
+        uint8_t             quality = 0;
+        double              reported_value = 0;
+        uint64_t            reported_time_ms = 0;
+        double              last_value = 0;      // Last value received, forwarded or not
+        uint64_t            last_time_ms = 0;    // Reception time of last_value
+        double              integral = 0;        // Deviation from reported_value integrated since it was forwarded
+    };
+
+    enum Verdict { FORWARD, SUPPRESS_DEADBAND, SUPPRESS_UNCHANGED };
+
+    Verdict m_evaluate(const IEC104Deadband& deadband, bool suppress_unchanged, PointState& state,
+                       double value, uint8_t quality, int cot);
+
+    std::unique_ptr<PointState[]>   m_states;
+    unsigned int                    m_suppress_unchanged;   // IEC104CotClass mask
+    uint64_t                        m_refresh_ms;
+
+    std::atomic<uint64_t>   m_forwarded{0};
+    std::atomic<uint64_t>   m_suppressed{0};            // By deadbands
+    std::atomic<uint64_t>   m_suppressed_unchanged{0};
+};
+
+#endif
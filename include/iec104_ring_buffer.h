@@ -0,0 +1,135 @@
+#ifndef _IEC104_RING_BUFFER_H
+#define _IEC104_RING_BUFFER_H
+
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+
+/**
+ * Bounded lock-free queue, safe for several producers and consumers.
+ *
+ * Each cell carries a sequence number telling whether it is free or filled for the
+ * current lap (D. Vyukov's bounded MPMC queue): producers and consumers only
+ * compete on one position counter each, and never wait on each other's locks.
+ * The capacity is rounded up to a power of two.
+ */
+template <class T>
+class IEC104RingBuffer
+{
+public:
+    explicit IEC104RingBuffer(size_t capacity) :
+        m_mask(m_roundUp(capacity) - 1),
+        m_cells(new Cell[m_mask + 1])
+    {
+        for (size_t i = 0; i <= m_mask; i++)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    IEC104RingBuffer(const IEC104RingBuffer&) = delete;
+    IEC104RingBuffer& operator=(const IEC104RingBuffer&) = delete;
+
+    /** Append item, or return false when the queue is full */
+    bool tryPush(const T& item)
+    {
+        Cell* cell;
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            cell = &m_cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+
+            if (diff == 0)
+            {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+
+        cell->data = item;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Remove the oldest item into item, or return false when the queue is empty */
+    bool tryPop(T& item)
+    {
+        Cell* cell;
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+
+        while (true)
+        {
+            cell = &m_cells[pos & m_mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t) sequence - (intptr_t) (pos + 1);
+
+            if (diff == 0)
+            {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+
+        item = cell->data;
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Number of items in the queue, exact only when no push or pop is in progress */
+    size_t size() const
+    {
+        size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T                   data;
+    };
+
+    static size_t m_roundUp(size_t capacity)
+    {
+        size_t rounded = 2;
+        while (rounded < capacity)
+            rounded <<= 1;
+        return rounded;
+    }
+
+    const size_t                m_mask;
+    std::unique_ptr<Cell[]>     m_cells;
+
+    // Producer and consumer positions are kept on separate cache lines
+    char                        m_pad0[64];
+    std::atomic<size_t>         m_enqueue_pos{0};
+    char                        m_pad1[64];
+    std::atomic<size_t>         m_dequeue_pos{0};
+    char                        m_pad2[64];
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef _IEC104_SCHEDULER_H
+#define _IEC104_SCHEDULER_H
+
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+/**
+ * Runs the timed tasks of the plugin (connections, interrogations, test commands,
+ * watchdogs) on a single thread, with millisecond resolution.
+ *
+ * Timers are kept in a hashed timer wheel of SLOTS one millisecond slots : a timer
+ * lives in the slot of its deadline modulo SLOTS, and the thread only visits the
+ * slots of the milliseconds that elapsed since its last wake up. It sleeps until
+ * the earliest deadline, or until a timer is added.
+ *
+ * Tasks run on the scheduler thread one after the other and must not block : a
+ * task that needs to wait schedules its continuation instead.
+ */
+class IEC104Scheduler
+{
+public:
+    typedef uint64_t                TimerId;
+    typedef std::function<void()>   Task;
+
+    IEC104Scheduler() = default;
+    ~IEC104Scheduler() { stop(); }
+
+    IEC104Scheduler(const IEC104Scheduler&) = delete;
+    IEC104Scheduler& operator=(const IEC104Scheduler&) = delete;
+
+    void start();
+
+    /**
+     * Cancel all timers and join the scheduler thread. Returns as soon as the
+     * running task, if any, returns.
+     */
+    void stop();
+
+    /** Run task once in delay_ms. Ignored, returning 0, when the scheduler is stopped */
+    TimerId schedule(uint64_t delay_ms, Task task);
+
+    /** Run task in first_delay_ms, then every period_ms */
+    TimerId scheduleEvery(uint64_t first_delay_ms, uint64_t period_ms, Task task);
+
+    /**
+     * Cancel a timer, including a timer already due whose task has not started yet.
+     * A periodic timer can be cancelled from its own task.
+     */
+    void cancel(TimerId id);
+
+    static uint64_t nowMs();
+
+private:
+    static const size_t SLOTS = 1024;
+
+    struct Timer
+    {
+        TimerId     id;
+        uint64_t    deadline_ms;
+        uint64_t    period_ms;      // 0 for a one shot timer
+        Task        task;
+    };
+
+    void m_run();
+    void m_insert(Timer timer);
+    uint64_t m_nextDeadline() const;
+
+    std::vector<Timer>                  m_wheel[SLOTS];
+    std::unordered_map<TimerId, size_t> m_slot_of;      // Slot of each pending timer
+    size_t                              m_timers = 0;   // Number of pending timers
+    std::unordered_set<TimerId>         m_due;          // Timers of the batch being run whose task has not started
+
+    uint64_t    m_current_ms = 0;   // Last millisecond whose slot was visited
+    TimerId     m_next_id = 1;
+    TimerId     m_running_id = 0;   // Timer whose task is running, 0 if none
+    bool        m_running_cancelled = false;
+
+    bool                        m_running = false;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_cv;
+    std::thread                 m_thread;
+};
+
+#endif
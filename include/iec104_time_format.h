@@ -0,0 +1,140 @@
+#ifndef _IEC104_TIME_FORMAT_H
+#define _IEC104_TIME_FORMAT_H
+
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <lib60870/cs104_connection.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+
+/**
+ * Formats CP56Time2a time tags as "YYYY-MM-DD HH:MM:SS.mmm", every field zero padded,
+ * into a buffer of the caller without any allocation.
+ *
+ * The "YYYY-MM-DD HH:MM" prefix of the last time tag is kept, and only the seconds
+ * and milliseconds are written when the next one falls in the same minute, as the
+ * elements of an ASDU nearly always do. Conversions to epoch milliseconds keep the
+ * epoch of the last minute the same way. An instance is not thread safe.
+ */
+class IEC104TimeFormatter
+{
+public:
+    static const size_t LENGTH = 23;
+
+    /** Write ts to out, which must hold LENGTH characters, and return LENGTH */
+    size_t format(const CP56Time2a ts, char* out)
+    {
+        long minute_key = m_minuteKey(ts);
+        if (minute_key != m_prefix_key)
+        {
+            int year = CP56Time2a_getYear(ts) + 2000;
+            int month = CP56Time2a_getMonth(ts);
+            int day = CP56Time2a_getDayOfMonth(ts);
+            int hour = CP56Time2a_getHour(ts);
+            int minute = CP56Time2a_getMinute(ts);
+
+
+            m_putPair(m_prefix, year / 100);
+            m_putPair(m_prefix + 2, year % 100);
+            m_prefix[4] = '-';
+            m_putPair(m_prefix + 5, month);
+            m_prefix[7] = '-';
+            m_putPair(m_prefix + 8, day);
+            m_prefix[10] = ' ';
+            m_putPair(m_prefix + 11, hour);
+            m_prefix[13] = ':';
+            m_putPair(m_prefix + 14, minute);
+            m_prefix_key = minute_key;
+        }
+        memcpy(out, m_prefix, PREFIX_LENGTH);
+
+        int ms = CP56Time2a_getMillisecond(ts);
+        if (ms > 999)
+            ms = 999;
+        out[16] = ':';
+        m_putPair(out + 17, CP56Time2a_getSecond(ts));
+        out[19] = '.';
+        out[20] = '0' + ms / 100;
+        m_putPair(out + 21, ms % 100);
+
+        return LENGTH;
+    }
+
+    /**
+     * Milliseconds since the Unix epoch of ts, read as UTC when utc is true and as
+     * local time of the host otherwise, summer time when the SU bit is set : the hour
+     * repeated when summer time ends is told apart by it.
+     */
+    int64_t toEpochMs(const CP56Time2a ts, bool utc)
+    {
+        bool summer_time = !utc && CP56Time2a_isSummerTime(ts);
+        long epoch_key = m_minuteKey(ts) * 2 + summer_time;
+        if (epoch_key != m_epoch_key || utc != m_epoch_utc)
+        {
+            struct tm tm = {};
+            tm.tm_year = CP56Time2a_getYear(ts) + 100;
+            tm.tm_mon = CP56Time2a_getMonth(ts) - 1;
+            tm.tm_mday = CP56Time2a_getDayOfMonth(ts);
+            tm.tm_hour = CP56Time2a_getHour(ts);
+            tm.tm_min = CP56Time2a_getMinute(ts);
+            tm.tm_isdst = summer_time ? 1 : 0;
+
+            m_epoch_minute_ms = (int64_t) (utc ? timegm(&tm) : mktime(&tm)) * 1000;
+            m_epoch_key = epoch_key;
+            m_epoch_utc = utc;
+        }
+
+        return m_epoch_minute_ms + CP56Time2a_getSecond(ts) * 1000 + CP56Time2a_getMillisecond(ts);
+    }
+
+private:
+    static const size_t PREFIX_LENGTH = 16;
+
+    // Minutes since year 2000, with 64 days per month and 32 hours per day so that no field overflows
+    static long m_minuteKey(const CP56Time2a ts)
+    {
+        return ((((long) CP56Time2a_getYear(ts) * 16 + CP56Time2a_getMonth(ts)) * 64
+                 + CP56Time2a_getDayOfMonth(ts)) * 32 + CP56Time2a_getHour(ts)) * 64 + CP56Time2a_getMinute(ts);
+    }
+
+    // Two decimal digits of value, in [0, 99]. Out of range fields of a corrupted time tag are clamped.
+    static void m_putPair(char* out, int value)
+    {
+        static const char digit_pairs[201] =
+            "00010203040506070809"
+            "10111213141516171819"
+            "20212223242526272829"
+            "30313233343536373839"
+            "40414243444546474849"
+            "50515253545556575859"
+            "60616263646566676869"
+            "70717273747576777879"
+            "80818283848586878889"
+            "90919293949596979899";
+
+        if (value < 0 || value > 99)
+            value = 99;
+        out[0] = digit_pairs[2 * value];
+        out[1] = digit_pairs[2 * value + 1];
+    }
+
+    long    m_prefix_key = -1;
+    char    m_prefix[PREFIX_LENGTH];
+
+    long    m_epoch_key = -1;     // Minute key and SU bit
+    bool    m_epoch_utc = false;
+    int64_t m_epoch_minute_ms = 0;
+};
+
+#endif
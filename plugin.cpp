@@ -21,6 +21,14 @@
 using namespace std;
 
 typedef void (*INGEST_CB)(void *, Reading);
+typedef void (*INGEST_CB2)(void *, std::vector<Reading *>*);
+
+// The 2.0.0 south plugin interface ingests batches of readings in a single call
+#ifdef FLEDGE_INGEST_V2
+#define PLUGIN_INTERFACE_VERSION "2.0.0"
+#else
+#define PLUGIN_INTERFACE_VERSION "1.0.0"
+#endif
 
 #define PLUGIN_NAME "iec104"
 
@@ -54,7 +62,12 @@ typedef void (*INGEST_CB)(void *, Reading);
          "t3_timeout":20,\
          "conn_all":true,\
          "start_all":false,\
-         "conn_passv":false\
+         "conn_passv":false,\
+         "reconnect_delay_min":1000,\
+         "reconnect_delay_max":60000,\
+         "capture_file":"",\
+         "capture_size":64,\
+         "capture_enabled":true\
       },\
       "application_layer":{\
          "orig_addr":0,\
@@ -66,6 +79,9 @@ typedef void (*INGEST_CB)(void *, Reading);
          "gi_cycle":false,\
          "gi_all_ca":false,\
          "gi_repeat_count":2,\
+         "gi_max_concurrent":1,\
+         "gi_pacing":100,\
+         "gi_groups":[],\
          "disc_qual":"NT",\
          "send_iv_time":0,\
          "tsiv":"REMOVE",\
@@ -75,7 +91,12 @@ typedef void (*INGEST_CB)(void *, Reading);
          "exec_cycl_test":false,\
          "startup_state":true,\
          "reverse":false,\
-         "time_sync":false\
+         "time_sync":false,\
+         "ingest_queue_size":65536,\
+         "suppress_unchanged":[],\
+         "unchanged_refresh":0,\
+         "stats_period":0,\
+         "latency_stats":false\
       }\
    }\
 })
@@ -131,7 +152,8 @@ typedef void (*INGEST_CB)(void *, Reading);
              "doi_ts_flag2":"isSummerTime",\
              "doi_ts_flag3":"isSubstituted"\
           }\
-       }\
+       },\
+       "time_marker_format":"string"\
     }\
 })
 
@@ -209,7 +231,7 @@ static PLUGIN_INFORMATION info = {
         VERSION,              // Version
         SP_ASYNC|SP_CONTROL,  // Flags - added control
         PLUGIN_TYPE_SOUTH,    // Type
-        "1.0.0",     // Interface version
+        PLUGIN_INTERFACE_VERSION, // Interface version
         default_config        // Default configuration
 };
 
@@ -239,8 +261,18 @@ PLUGIN_HANDLE plugin_init(ConfigCategory *config)
 
     if (config->itemExists("protocol_stack")       && config->itemExists("exchanged_data")
      && config->itemExists("protocol_translation") && config->itemExists("tls"))
-        iec104->setJsonConfig(config->getValue("protocol_stack"), config->getValue("exchanged_data"),
-                              config->getValue("protocol_translation"), config->getValue("tls"));
+    {
+        // An invalid configuration must not throw out of the plugin : start() refuses to run without one
+        try
+        {
+            iec104->setJsonConfig(config->getValue("protocol_stack"), config->getValue("exchanged_data"),
+                                  config->getValue("protocol_translation"), config->getValue("tls"));
+        }
+        catch (IEC104ConfigError& e)
+        {
+            Logger::getLogger()->error("104 plugin configuration rejected, waiting for a valid one");
+        }
+    }
 
     return (PLUGIN_HANDLE) iec104;
 }
@@ -259,6 +291,27 @@ void plugin_start(PLUGIN_HANDLE *handle)
     iec104->start();
 }
 
+#ifdef FLEDGE_INGEST_V2
+/**
+ * Register multi-reading ingest callback
+ */
+void plugin_register_ingest(PLUGIN_HANDLE *handle, INGEST_CB2 cb, void *data)
+{
+    if (!handle)
+        throw new exception();
+
+    auto *iec104 = (IEC104 *) handle;
+    iec104->registerIngestV2(data, cb);
+}
+
+/**
+ * Poll for plugin readings
+ */
+std::vector<Reading *>* plugin_poll(PLUGIN_HANDLE *handle)
+{
+    throw runtime_error("IEC_104 is an async plugin, poll should not be called");
+}
+#else
 /**
  * Register ingest callback
  */
@@ -278,6 +331,7 @@ Reading plugin_poll(PLUGIN_HANDLE *handle)
 {
     throw runtime_error("IEC_104 is an async plugin, poll should not be called");
 }
+#endif
 
 /**
  * Reconfigure the plugin
@@ -289,8 +343,18 @@ void plugin_reconfigure(PLUGIN_HANDLE *handle, string &newConfig)
 
     if (config.itemExists("protocol_stack")       && config.itemExists("exchanged_data")
         && config.itemExists("protocol_translation") && config.itemExists("tls"))
-        iec104->setJsonConfig(config.getValue("protocol_stack"), config.getValue("exchanged_data"),
-                              config.getValue("protocol_translation"), config.getValue("tls"));
+    {
+        try
+        {
+            iec104->setJsonConfig(config.getValue("protocol_stack"), config.getValue("exchanged_data"),
+                                  config.getValue("protocol_translation"), config.getValue("tls"));
+        }
+        catch (IEC104ConfigError& e)
+        {
+            Logger::getLogger()->error("104 plugin reconfigure rejected, keeping previous configuration");
+            return;
+        }
+    }
 
     if (config.itemExists("asset"))
     {
@@ -0,0 +1,173 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+/**
+ * IEC 104 outstation simulator, serving the points of an exchanged_data configuration
+ * of the plugin. It runs until interrupted, or for the given duration, and prints the
+ * number of values sent every second.
+ *
+ * Usage : iec104_sim <exchanged_data.json> [options]
+ *   --bind <ip>                   Listening address, 127.0.0.1 by default
+ *   --port <port>                 2404 by default
+ *   --ca-size <1|2>               ca_asdu_size, 2 by default
+ *   --ioa-size <1|2|3>            ioaddr_size, 3 by default
+ *   --rate <TypeID>=<values/s>    Spontaneous rate of a TypeID, may be repeated
+ *   --cyclic <ms>                 Send every point with COT periodic on this period
+ *   --burst <ms>:<values>         Send this many spontaneous values at once on this period
+ *   --queue <ASDUs>               Queue size of the lib60870 outstation, 100000 by default
+ *   --asdu-elements <n>           Information objects per ASDU at most, as many as fit by default
+ *   --tls <key> <cert> <ca_cert>  Accept TLS connections only
+ *   --duration <s>                Stop after this many seconds
+ */
+
+#include "iec104_simulator.h"
+#include <iec104_config.h>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+
+static atomic<bool> running(true);
+
+static void onSignal(int)
+{
+    running = false;
+}
+
+
+static int usage(const char* program)
+{
+    fprintf(stderr, "Usage : %s <exchanged_data.json> [--bind ip] [--port port] [--ca-size n] [--ioa-size n]\n"
+                    "       [--rate TypeID=values/s]... [--cyclic ms] [--burst ms:values] [--queue ASDUs]\n"
+                    "       [--asdu-elements n] [--tls key cert ca_cert] [--duration s]\n", program);
+    return 2;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+        return usage(argv[0]);
+
+    IEC104SimulatorConfig config;
+    int duration_s = 0;
+
+    for (int i = 2; i < argc; i++)
+    {
+        string option = argv[i];
+        bool has_value = i + 1 < argc;
+
+        if (option == "--bind" && has_value)
+            config.bind_ip = argv[++i];
+        else if (option == "--port" && has_value)
+            config.port = atoi(argv[++i]);
+        else if (option == "--ca-size" && has_value)
+            config.ca_asdu_size = atoi(argv[++i]);
+        else if (option == "--ioa-size" && has_value)
+            config.ioaddr_size = atoi(argv[++i]);
+        else if (option == "--queue" && has_value)
+            config.queue_size = atoi(argv[++i]);
+        else if (option == "--asdu-elements" && has_value)
+            config.asdu_elements = atoi(argv[++i]);
+        else if (option == "--cyclic" && has_value)
+            config.cyclic_period_ms = atoi(argv[++i]);
+        else if (option == "--duration" && has_value)
+            duration_s = atoi(argv[++i]);
+        else if (option == "--rate" && has_value)
+        {
+            string rate = argv[++i];
+            size_t equal = rate.find('=');
+            int type_id = IEC104Config::getTypeIdFromString(rate.substr(0, equal));
+            if (equal == string::npos || type_id < 0)
+            {
+                fprintf(stderr, "Invalid rate %s, expected <TypeID>=<values/s>\n", rate.c_str());
+                return 2;
+            }
+            config.rates[type_id] = atof(rate.c_str() + equal + 1);
+        }
+        else if (option == "--burst" && has_value)
+        {
+            string burst = argv[++i];
+            size_t colon = burst.find(':');
+            if (colon == string::npos)
+            {
+                fprintf(stderr, "Invalid burst %s, expected <ms>:<values>\n", burst.c_str());
+                return 2;
+            }
+            config.burst_period_ms = atoi(burst.c_str());
+            config.burst_size = atoi(burst.c_str() + colon + 1);
+        }
+        else if (option == "--tls" && i + 3 < argc)
+        {
+            config.tls = true;
+            config.private_key = argv[++i];
+            config.own_cert = argv[++i];
+            config.ca_cert = argv[++i];
+        }
+        else
+            return usage(argv[0]);
+    }
+
+    ifstream file(argv[1]);
+    if (!file)
+    {
+        fprintf(stderr, "Couldn't open %s\n", argv[1]);
+        return 1;
+    }
+    stringstream exchanged_data;
+    exchanged_data << file.rdbuf();
+
+    IEC104Simulator simulator(config);
+    try
+    { simulator.loadPoints(exchanged_data.str()); }
+    catch (exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    try
+    { simulator.start(); }
+    catch (exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    printf("Serving %zu points on %s:%d%s\n", simulator.points(), config.bind_ip.c_str(), config.port,
+           config.tls ? " with TLS" : "");
+
+    uint64_t last_sent = 0;
+    for (int elapsed_s = 0; running && (duration_s == 0 || elapsed_s < duration_s); elapsed_s++)
+    {
+        this_thread::sleep_for(chrono::seconds(1));
+
+        uint64_t sent = simulator.sentValues();
+        printf("%d s : %llu values/s, %llu interrogated values, %d connection(s)\n", elapsed_s + 1,
+               (unsigned long long) (sent - last_sent), (unsigned long long) simulator.interrogatedValues(),
+               simulator.openConnections());
+        fflush(stdout);
+        last_sent = sent;
+    }
+
+    simulator.stop();
+    return 0;
+}
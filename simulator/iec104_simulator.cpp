@@ -0,0 +1,374 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include "iec104_simulator.h"
+#include <iec104_config.h>
+#include <lib60870/hal_time.h>
+#include <json.hpp> // https://github.com/nlohmann/json
+#include <chrono>
+#include <stdexcept>
+
+
+using namespace std;
+using namespace nlohmann;
+
+
+IEC104Simulator::IEC104Simulator(const IEC104SimulatorConfig& config) :
+    m_config(config)
+{
+}
+
+
+IEC104Simulator::~IEC104Simulator()
+{
+    stop();
+}
+
+
+void IEC104Simulator::loadPoints(const string& exchanged_data)
+{
+    json root;
+    try
+    { root = json::parse(exchanged_data); }
+    catch (json::parse_error& e)
+    { throw runtime_error("Couldn't read exchanged_data json : " + string(e.what())); }
+
+    if (!root.contains("exchanged_data") || !root["exchanged_data"].contains("asdu_list")
+        || !root["exchanged_data"]["asdu_list"].is_array())
+        throw runtime_error("exchanged_data/asdu_list must be an array");
+
+    const json& asdu_list = root["exchanged_data"]["asdu_list"];
+    m_points.clear();
+    m_points_by_type.clear();
+    m_next_point.clear();
+
+    for (size_t i = 0; i < asdu_list.size(); i++)
+    {
+        const json& element = asdu_list[i];
+        try
+        {
+            string type_name = element.at("type_id").get<string>();
+            int type_id = IEC104Config::getTypeIdFromString(type_name);
+            if (type_id < 0)
+                throw runtime_error("unsupported type_id " + type_name);
+
+            m_points_by_type[type_id].push_back(m_points.size());
+            m_points.push_back(IEC104SimulatorPoint{element.at("ca").get<unsigned int>(), type_id,
+                                                    element.at("ioa").get<unsigned int>()});
+        }
+        catch (json::exception& e)
+        { throw runtime_error("exchanged_data/asdu_list/" + to_string(i) + " : " + e.what()); }
+    }
+
+    m_changes.reset(new atomic<uint32_t>[m_points.size()]);
+    for (size_t i = 0; i < m_points.size(); i++)
+        m_changes[i].store(0, memory_order_relaxed);
+}
+
+
+void IEC104Simulator::start()
+{
+    if (m_running.exchange(true))
+        return;
+
+    if (m_config.tls)
+    {
+        m_tls_config = TLSConfiguration_create();
+        const string* failed = nullptr;
+        if (!TLSConfiguration_setOwnKeyFromFile(m_tls_config, m_config.private_key.c_str(), nullptr))
+            failed = &m_config.private_key;
+        else if (!TLSConfiguration_setOwnCertificateFromFile(m_tls_config, m_config.own_cert.c_str()))
+            failed = &m_config.own_cert;
+        else if (!TLSConfiguration_addCACertificateFromFile(m_tls_config, m_config.ca_cert.c_str()))
+            failed = &m_config.ca_cert;
+
+        if (failed != nullptr)
+        {
+            TLSConfiguration_destroy(m_tls_config);
+            m_tls_config = nullptr;
+            m_running = false;
+            throw runtime_error("Couldn't load TLS file " + *failed);
+        }
+        TLSConfiguration_setChainValidation(m_tls_config, true);
+        m_slave = CS104_Slave_createSecure(m_config.queue_size, m_config.queue_size, m_tls_config);
+    }
+    else
+        m_slave = CS104_Slave_create(m_config.queue_size, m_config.queue_size);
+
+    CS104_Slave_setLocalAddress(m_slave, m_config.bind_ip.c_str());
+    CS104_Slave_setLocalPort(m_slave, m_config.port);
+    CS104_Slave_setServerMode(m_slave, CS104_MODE_SINGLE_REDUNDANCY_GROUP);
+
+    CS101_AppLayerParameters parameters = CS104_Slave_getAppLayerParameters(m_slave);
+    parameters->originatorAddress = m_config.orig_addr;
+    parameters->sizeOfCA = m_config.ca_asdu_size;
+    parameters->sizeOfIOA = m_config.ioaddr_size;
+
+    CS104_Slave_setInterrogationHandler(m_slave, m_interrogationHandler, this);
+    CS104_Slave_start(m_slave);
+
+    m_thread = thread(&IEC104Simulator::m_run, this);
+}
+
+
+void IEC104Simulator::stop()
+{
+    if (!m_running.exchange(false))
+        return;
+
+    m_thread.join();
+
+    CS104_Slave_stop(m_slave);
+    CS104_Slave_destroy(m_slave);
+    m_slave = nullptr;
+
+    if (m_tls_config != nullptr)
+        TLSConfiguration_destroy(m_tls_config);
+    m_tls_config = nullptr;
+}
+
+
+/** Traffic generator thread : one tick per millisecond */
+void IEC104Simulator::m_run()
+{
+    map<int, double> credits;
+    uint64_t last_cyclic_ms = Hal_getTimeInMs();
+    uint64_t last_burst_ms = last_cyclic_ms;
+
+    vector<size_t> all_points(m_points.size());
+    for (size_t i = 0; i < all_points.size(); i++)
+        all_points[i] = i;
+
+    auto enqueue = [this](CS101_ASDU asdu) { CS104_Slave_enqueueASDU(m_slave, asdu); };
+    auto next_tick = chrono::steady_clock::now();
+
+    while (m_running.load())
+    {
+        next_tick += chrono::milliseconds(1);
+        this_thread::sleep_until(next_tick);
+
+        // Ticks missed while sending are not caught up beyond 100 ms
+        auto now = chrono::steady_clock::now();
+        if (now > next_tick + chrono::milliseconds(100))
+            next_tick = now;
+
+        for (auto& rate : m_config.rates)
+        {
+            double& credit = credits[rate.first];
+            credit += rate.second / 1000;
+
+            size_t count = (size_t) credit;
+            credit -= count;
+            if (count > 0)
+                m_sendSpontaneous(rate.first, count);
+        }
+
+        uint64_t now_ms = Hal_getTimeInMs();
+
+        if (m_config.cyclic_period_ms > 0 && now_ms - last_cyclic_ms >= (uint64_t) m_config.cyclic_period_ms)
+        {
+            last_cyclic_ms = now_ms;
+            m_sendPoints(all_points, CS101_COT_PERIODIC, CS104_Slave_getAppLayerParameters(m_slave), enqueue);
+        }
+
+        // A burst is shared among the TypeIDs of the configuration
+        if (m_config.burst_period_ms > 0 && now_ms - last_burst_ms >= (uint64_t) m_config.burst_period_ms
+            && !m_points_by_type.empty())
+        {
+            last_burst_ms = now_ms;
+            size_t share = m_config.burst_size / m_points_by_type.size();
+            size_t remainder = m_config.burst_size % m_points_by_type.size();
+
+            for (auto& type : m_points_by_type)
+            {
+                size_t count = share + (remainder > 0 ? 1 : 0);
+                if (remainder > 0)
+                    remainder--;
+                if (count > 0)
+                    m_sendSpontaneous(type.first, count);
+            }
+        }
+    }
+}
+
+
+/** Change the next count points of type_id, in round robin, and send them with COT spontaneous */
+void IEC104Simulator::m_sendSpontaneous(int type_id, size_t count)
+{
+    auto points = m_points_by_type.find(type_id);
+    if (points == m_points_by_type.end())
+        return;
+
+    const vector<size_t>& type_points = points->second;
+    size_t& next = m_next_point[type_id];
+
+    vector<size_t> indexes;
+    indexes.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t index = type_points[next];
+        next = (next + 1) % type_points.size();
+
+        m_changes[index].fetch_add(1, memory_order_relaxed);
+        indexes.push_back(index);
+    }
+
+    m_sendPoints(indexes, CS101_COT_SPONTANEOUS, CS104_Slave_getAppLayerParameters(m_slave),
+                 [this](CS101_ASDU asdu) { CS104_Slave_enqueueASDU(m_slave, asdu); });
+}
+
+
+/** Send points, consecutive points of the same CA and TypeID sharing an ASDU as long as it has room */
+void IEC104Simulator::m_sendPoints(const vector<size_t>& indexes, CS101_CauseOfTransmission cot,
+                                   CS101_AppLayerParameters parameters, const AsduSink& sink)
+{
+    CS101_ASDU asdu = nullptr;
+    const IEC104SimulatorPoint* asdu_point = nullptr;
+    uint64_t now_ms = Hal_getTimeInMs();
+
+    for (size_t index : indexes)
+    {
+        const IEC104SimulatorPoint& point = m_points[index];
+        InformationObject io = createObject(point, m_changes[index].load(memory_order_relaxed), now_ms);
+
+        if (asdu != nullptr && (point.ca != asdu_point->ca || point.type_id != asdu_point->type_id
+                                || CS101_ASDU_getNumberOfElements(asdu) == m_config.asdu_elements
+                                || !CS101_ASDU_addInformationObject(asdu, io)))
+        {
+            sink(asdu);
+            CS101_ASDU_destroy(asdu);
+            asdu = nullptr;
+        }
+
+        if (asdu == nullptr)
+        {
+            asdu = CS101_ASDU_create(parameters, false, cot, m_config.orig_addr, point.ca, false, false);
+            asdu_point = &point;
+            CS101_ASDU_addInformationObject(asdu, io);
+        }
+
+        InformationObject_destroy(io);
+    }
+
+    if (asdu != nullptr)
+    {
+        sink(asdu);
+        CS101_ASDU_destroy(asdu);
+    }
+
+    (cot == CS101_COT_SPONTANEOUS || cot == CS101_COT_PERIODIC ? m_sent_values : m_interrogated_values)
+        .fetch_add(indexes.size(), memory_order_relaxed);
+}
+
+
+InformationObject IEC104Simulator::createObject(const IEC104SimulatorPoint& point, uint32_t changes, uint64_t now_ms)
+{
+    int ioa = point.ioa;
+    QualityDescriptor quality = IEC60870_QUALITY_GOOD;
+
+    bool single = changes & 1;
+    DoublePointValue double_point = (changes & 1) ? IEC60870_DOUBLE_POINT_ON : IEC60870_DOUBLE_POINT_OFF;
+    int step = (int) (changes % 127) - 63;
+    float normalized = ((int) (changes % 2001) - 1000) / 1001.0f;
+    int scaled = (int) (changes % 65536) - 32768;
+    float real = changes * 0.1f;
+
+    sCP56Time2a cp56;
+    CP56Time2a_createFromMsTimestamp(&cp56, now_ms);
+
+    sCP24Time2a cp24{};
+    CP24Time2a_setMillisecond(&cp24, now_ms % 1000);
+    CP24Time2a_setSecond(&cp24, (now_ms / 1000) % 60);
+    CP24Time2a_setMinute(&cp24, (now_ms / 60000) % 60);
+
+    switch (point.type_id)
+    {
+        case M_SP_NA_1: return (InformationObject) SinglePointInformation_create(nullptr, ioa, single, quality);
+        case M_SP_TA_1: return (InformationObject) SinglePointWithCP24Time2a_create(nullptr, ioa, single, quality, &cp24);
+        case M_SP_TB_1: return (InformationObject) SinglePointWithCP56Time2a_create(nullptr, ioa, single, quality, &cp56);
+
+        case M_DP_NA_1: return (InformationObject) DoublePointInformation_create(nullptr, ioa, double_point, quality);
+        case M_DP_TA_1: return (InformationObject) DoublePointWithCP24Time2a_create(nullptr, ioa, double_point, quality, &cp24);
+        case M_DP_TB_1: return (InformationObject) DoublePointWithCP56Time2a_create(nullptr, ioa, double_point, quality, &cp56);
+
+        case M_ST_NA_1: return (InformationObject) StepPositionInformation_create(nullptr, ioa, step, false, quality);
+        case M_ST_TA_1: return (InformationObject) StepPositionWithCP24Time2a_create(nullptr, ioa, step, false, quality, &cp24);
+        case M_ST_TB_1: return (InformationObject) StepPositionWithCP56Time2a_create(nullptr, ioa, step, false, quality, &cp56);
+
+        case M_BO_NA_1: return (InformationObject) BitString32_create(nullptr, ioa, changes);
+        case M_BO_TA_1: return (InformationObject) Bitstring32WithCP24Time2a_create(nullptr, ioa, changes, &cp24);
+        case M_BO_TB_1: return (InformationObject) Bitstring32WithCP56Time2a_create(nullptr, ioa, changes, &cp56);
+
+        case M_ME_NA_1: return (InformationObject) MeasuredValueNormalized_create(nullptr, ioa, normalized, quality);
+        case M_ME_TA_1: return (InformationObject) MeasuredValueNormalizedWithCP24Time2a_create(nullptr, ioa, normalized, quality, &cp24);
+        case M_ME_TD_1: return (InformationObject) MeasuredValueNormalizedWithCP56Time2a_create(nullptr, ioa, normalized, quality, &cp56);
+
+        case M_ME_NB_1: return (InformationObject) MeasuredValueScaled_create(nullptr, ioa, scaled, quality);
+        case M_ME_TB_1: return (InformationObject) MeasuredValueScaledWithCP24Time2a_create(nullptr, ioa, scaled, quality, &cp24);
+        case M_ME_TE_1: return (InformationObject) MeasuredValueScaledWithCP56Time2a_create(nullptr, ioa, scaled, quality, &cp56);
+
+        case M_ME_NC_1: return (InformationObject) MeasuredValueShort_create(nullptr, ioa, real, quality);
+        case M_ME_TC_1: return (InformationObject) MeasuredValueShortWithCP24Time2a_create(nullptr, ioa, real, quality, &cp24);
+        case M_ME_TF_1: return (InformationObject) MeasuredValueShortWithCP56Time2a_create(nullptr, ioa, real, quality, &cp56);
+
+        default:
+        {
+            // Integrated totals : the counter reading is copied into the information object
+            BinaryCounterReading bcr = BinaryCounterReading_create(nullptr, (int32_t) changes, changes % 32, false, false, false);
+            InformationObject io;
+            if (point.type_id == M_IT_TA_1)
+                io = (InformationObject) IntegratedTotalsWithCP24Time2a_create(nullptr, ioa, bcr, &cp24);
+            else if (point.type_id == M_IT_TB_1)
+                io = (InformationObject) IntegratedTotalsWithCP56Time2a_create(nullptr, ioa, bcr, &cp56);
+            else
+                io = (InformationObject) IntegratedTotals_create(nullptr, ioa, bcr);
+            BinaryCounterReading_destroy(bcr);
+            return io;
+        }
+    }
+}
+
+
+/**
+ * Answer a station (QOI 20) or group (QOI 21 to 36) interrogation with ACTCON, the points
+ * of the CA, then ACTTERM. Points are spread over the 16 groups by their position in the
+ * configuration.
+ */
+bool IEC104Simulator::m_interrogationHandler(void* parameter, IMasterConnection connection, CS101_ASDU asdu,
+                                             QualifierOfInterrogation qoi)
+{
+    auto simulator = static_cast<IEC104Simulator*>(parameter);
+    unsigned int ca = CS101_ASDU_getCA(asdu);
+    unsigned int broadcast_ca = (1u << (8 * simulator->m_config.ca_asdu_size)) - 1;
+
+    if (qoi < IEC60870_QOI_STATION || qoi > IEC60870_QOI_GROUP_16)
+    {
+        IMasterConnection_sendACT_CON(connection, asdu, true);
+        return true;
+    }
+
+    vector<size_t> indexes;
+    for (size_t i = 0; i < simulator->m_points.size(); i++)
+    {
+        if (ca != broadcast_ca && simulator->m_points[i].ca != ca)
+            continue;
+        if (qoi != IEC60870_QOI_STATION && (int) (i % 16) != qoi - IEC60870_QOI_GROUP_1)
+            continue;
+        indexes.push_back(i);
+    }
+
+    IMasterConnection_sendACT_CON(connection, asdu, false);
+    simulator->m_sendPoints(indexes, (CS101_CauseOfTransmission) qoi,
+                            IMasterConnection_getApplicationLayerParameters(connection),
+                            [connection](CS101_ASDU response) { IMasterConnection_sendASDU(connection, response); });
+    IMasterConnection_sendACT_TERM(connection, asdu);
+
+    return true;
+}
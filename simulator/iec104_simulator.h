@@ -0,0 +1,114 @@
+#ifndef _IEC104_SIMULATOR_H
+#define _IEC104_SIMULATOR_H
+
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <lib60870/cs104_slave.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct IEC104SimulatorConfig
+{
+    std::string         bind_ip = "127.0.0.1";
+    int                 port = 2404;
+    int                 orig_addr = 0;
+    int                 ca_asdu_size = 2;
+    int                 ioaddr_size = 3;
+    int                 queue_size = 100000;    // ASDUs buffered by lib60870 for the client
+    int                 asdu_elements = 0;      // Information objects per ASDU at most, 0 for as many as fit
+
+    bool                tls = false;
+    std::string         private_key;
+    std::string         own_cert;
+    std::string         ca_cert;
+
+    std::map<int, double> rates;            // Spontaneous values per second, by TypeID
+    int                 cyclic_period_ms = 0;   // Every point sent with COT periodic, 0 for never
+    int                 burst_period_ms = 0;    // burst_size spontaneous values at once, 0 for never
+    int                 burst_size = 0;
+};
+
+/** Information object of the exchanged_data configuration, as sent by the simulator */
+struct IEC104SimulatorPoint
+{
+    unsigned int    ca;
+    int             type_id;
+    unsigned int    ioa;
+};
+
+/**
+ * IEC 104 outstation built on the lib60870 CS104_Slave, for load generation on
+ * localhost. It serves the points of an exchanged_data configuration : station and
+ * group interrogations are answered with every point of the CA (of every CA for the
+ * broadcast address), and values change at the configured spontaneous rates, on
+ * the cyclic period and in bursts. Values are derived from a per point change
+ * counter, so that two runs send the same sequence.
+ */
+class IEC104Simulator
+{
+public:
+    explicit IEC104Simulator(const IEC104SimulatorConfig& config);
+    ~IEC104Simulator();
+
+    IEC104Simulator(const IEC104Simulator&) = delete;
+    IEC104Simulator& operator=(const IEC104Simulator&) = delete;
+
+    /** Load the asdu_list of an exchanged_data json configuration, throws std::runtime_error */
+    void loadPoints(const std::string& exchanged_data);
+
+    /** Start serving the points, throws std::runtime_error if a TLS file can't be loaded */
+    void start();
+    void stop();
+
+    size_t points() const { return m_points.size(); }
+    int openConnections() { return CS104_Slave_getOpenConnections(m_slave); }
+
+    // Values sent, spontaneous and cyclic ones, and in answer to interrogations
+    uint64_t sentValues() const { return m_sent_values.load(std::memory_order_relaxed); }
+    uint64_t interrogatedValues() const { return m_interrogated_values.load(std::memory_order_relaxed); }
+
+    /** Information object of point, its value derived from changes, to be destroyed by the caller */
+    static InformationObject createObject(const IEC104SimulatorPoint& point, uint32_t changes, uint64_t now_ms);
+
+private:
+    typedef std::function<void(CS101_ASDU)> AsduSink;
+
+    void m_run();
+    void m_sendSpontaneous(int type_id, size_t count);
+    void m_sendPoints(const std::vector<size_t>& indexes, CS101_CauseOfTransmission cot,
+                      CS101_AppLayerParameters parameters, const AsduSink& sink);
+
+    static bool m_interrogationHandler(void* parameter, IMasterConnection connection, CS101_ASDU asdu,
+                                       QualifierOfInterrogation qoi);
+
+    IEC104SimulatorConfig   m_config;
+    CS104_Slave             m_slave = nullptr;
+    TLSConfiguration        m_tls_config = nullptr;
+
+    std::vector<IEC104SimulatorPoint>       m_points;
+    std::unique_ptr<std::atomic<uint32_t>[]> m_changes;     // Change counter of each point, its value is derived from it
+    std::map<int, std::vector<size_t>>      m_points_by_type;
+    std::map<int, size_t>                   m_next_point;   // Round robin position in m_points_by_type
+
+    std::thread             m_thread;
+    std::atomic<bool>       m_running{false};
+    std::atomic<uint64_t>   m_sent_values{0};
+    std::atomic<uint64_t>   m_interrogated_values{0};
+};
+
+#endif
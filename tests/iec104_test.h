@@ -0,0 +1,80 @@
+#ifndef _IEC104_TEST_H
+#define _IEC104_TEST_H
+
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+#include <json.hpp> // https://github.com/nlohmann/json
+
+#include <cstdio>
+#include <string>
+
+
+/**
+ * Checks of the unit tests : each one prints OK or FAILED with what it checks, and
+ * main() returns testResult(), the exit code ctest expects.
+ */
+inline int& testFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+inline void check(bool condition, const char* what)
+{
+    printf("%s: %s\n", condition ? "OK" : "FAILED", what);
+    if (!condition)
+        testFailures()++;
+}
+
+inline int testResult()
+{
+    return testFailures() == 0 ? 0 : 1;
+}
+
+/** protocol_stack of one path to 127.0.0.1, application items replacing the defaults of the application_layer */
+inline std::string testProtocolStack(const nlohmann::json& application = nlohmann::json::object())
+{
+    nlohmann::json stack = nlohmann::json::parse(R"({
+        "protocol_stack":{
+           "transport_layer":{
+              "connection":{ "path":[ { "srv_ip":"127.0.0.1", "port":2404 } ], "tls":false },
+              "llevel":4, "k_value":12, "w_value":8,
+              "t0_timeout":10, "t1_timeout":15, "t2_timeout":10, "t3_timeout":20,
+              "conn_all":true, "conn_passv":false
+           },
+           "application_layer":{
+              "orig_addr":0, "ca_asdu_size":2, "ioaddr_size":3, "startup_time":180, "asdu_size":0,
+              "gi_time":60, "gi_cycle":false, "gi_all_ca":false, "gi_repeat_count":2, "tsiv":"REMOVE",
+              "comm_wttag":false, "exec_cycl_test":false, "startup_state":true, "time_sync":false
+           }
+        }
+    })");
+    stack["protocol_stack"]["application_layer"].update(application);
+    return stack.dump();
+}
+
+/** exchanged_data of the elements of asdu_list */
+inline std::string testExchangedData(const nlohmann::json& asdu_list)
+{
+    return nlohmann::json{{"exchanged_data", {{"asdu_list", asdu_list}}}}.dump();
+}
+
+/** protocol_translation of the type, CA, IOA and value of the elements only */
+const char* const TEST_TRANSLATION = R"({
+    "protocol_translation":{
+       "mapping":{
+          "data_object_header":{ "doh_type":"type_id", "doh_ca":"ca" },
+          "data_object_item":{ "doi_ioa":"ioa", "doi_value":"value" }
+       }
+    }
+})";
+
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+/**
+ * Accounting of the answers to a broadcast GI : each CA terminates it with its own
+ * address, or the broadcast address terminates it for all of them. CAs that don't
+ * answer before the timeout are interrogated one at a time.
+ *
+ * The tasks of the command planner are called directly, as the scheduler would, with
+ * no connection : commands are "sent" to no path, and the scheduler is not started.
+ */
+
+#include <iec104.h>
+#include "iec104_test.h"
+
+using namespace std;
+using namespace nlohmann;
+
+
+/** Access to the private command planner of the plugin */
+class IEC104Test
+{
+public:
+    explicit IEC104Test(IEC104& iec104) : m_iec104(iec104)
+    {
+        m_iec104.m_active_config = atomic_load(&IEC104::m_config);
+        m_iec104.m_client = new IEC104Client(&m_iec104, m_iec104.m_active_config);
+        m_broadcast_ca = m_iec104.m_active_config->getBroadcastCA();
+    }
+
+    void startRound() { m_iec104.m_sendInterrogationCommmands(); }
+
+    void respond(unsigned int ca, int cot, bool negative = false)
+    { m_iec104.m_onCommandResponse(C_IC_NA_1, ca, IEC60870_QOI_STATION, cot, negative); }
+
+    void respondAll(int cot) { respond(m_broadcast_ca, cot); }
+
+    void timeout()
+    {
+        auto it = m_iec104.m_commands_in_flight.find(m_broadcast_ca);
+        if (it != m_iec104.m_commands_in_flight.end())
+            m_iec104.m_onCommandTimeout(m_broadcast_ca, it->second.sequence);
+    }
+
+    bool roundInProgress() const { return m_iec104.m_gi_in_progress; }
+    unsigned int roundPending() const { return m_iec104.m_gi_round_pending; }
+    unsigned int roundDone() const { return m_iec104.m_gi_round_done; }
+    unsigned int roundFailed() const { return m_iec104.m_gi_round_failed; }
+    bool broadcastInFlight() const { return m_iec104.m_commands_in_flight.count(m_broadcast_ca) != 0; }
+    bool awaited(unsigned int ca) const { return m_iec104.m_broadcast_pending.count(ca) != 0; }
+
+    /** A GI of its own is queued or in flight for ca */
+    bool interrogated(unsigned int ca) const
+    {
+        for (auto& command : m_iec104.m_command_queue)
+            if (command.ca == ca && command.kind == IEC104Command::INTERROGATION)
+                return true;
+        return m_iec104.m_commands_in_flight.count(ca) != 0;
+    }
+
+private:
+    IEC104&         m_iec104;
+    unsigned int    m_broadcast_ca;
+};
+
+
+int main()
+{
+    json asdu_list = json::array();
+    for (int ca = 1; ca <= 3; ca++)
+        asdu_list.push_back({{"ca", ca}, {"type_id", "M_ME_NC_1"}, {"label", "P-" + to_string(ca)}, {"ioa", 1}});
+    IEC104::setJsonConfig(testProtocolStack(), testExchangedData(asdu_list), TEST_TRANSLATION, "{}");
+
+    {
+        IEC104 iec104;
+        IEC104Test test(iec104);
+
+        test.startRound();
+        check(test.broadcastInFlight(), "one broadcast GI sent");
+        check(test.roundPending() == 3 && test.awaited(1) && test.awaited(2) && test.awaited(3), "every CA awaited");
+
+        test.respond(1, CS101_COT_ACTIVATION_CON);
+        check(test.roundPending() == 3 && test.awaited(1), "ACTCON of a CA does not terminate it");
+
+        test.respond(1, CS101_COT_ACTIVATION_TERMINATION);
+        check(test.roundPending() == 2 && !test.awaited(1) && test.roundDone() == 1, "ACTTERM of CA 1 counted as done");
+
+        test.respond(1, CS101_COT_ACTIVATION_TERMINATION);
+        check(test.roundPending() == 2 && test.roundDone() == 1, "repeated ACTTERM of CA 1 not counted twice");
+
+        test.respond(2, CS101_COT_ACTIVATION_TERMINATION, true);
+        check(test.roundPending() == 1 && test.roundFailed() == 1, "negative ACTTERM of CA 2 counted as failed");
+
+        test.respond(3, CS101_COT_ACTIVATION_TERMINATION);
+        check(!test.broadcastInFlight() && !test.roundInProgress() && test.roundDone() == 2,
+              "last ACTTERM completes the broadcast GI and the round");
+
+        iec104.stop();
+    }
+
+    {
+        IEC104 iec104;
+        IEC104Test test(iec104);
+
+        test.startRound();
+        test.respond(2, CS101_COT_ACTIVATION_TERMINATION);
+        test.respondAll(CS101_COT_ACTIVATION_TERMINATION);
+        check(!test.broadcastInFlight() && !test.roundInProgress() && test.roundDone() == 3 && test.roundFailed() == 0,
+              "ACTTERM with the broadcast address terminates it for the CAs left");
+
+        iec104.stop();
+    }
+
+    {
+        IEC104 iec104;
+        IEC104Test test(iec104);
+
+        test.startRound();
+        test.respond(1, CS101_COT_ACTIVATION_TERMINATION);
+        test.timeout();
+        check(!test.broadcastInFlight() && !test.awaited(2) && !test.awaited(3), "timeout ends the broadcast GI");
+        check(!test.interrogated(1) && test.interrogated(2) && test.interrogated(3),
+              "CAs that did not answer interrogated one at a time");
+        check(test.roundInProgress() && test.roundPending() == 2 && test.roundDone() == 1,
+              "round goes on with the GIs of their own");
+
+        iec104.stop();
+    }
+
+    return testResult();
+}
@@ -0,0 +1,73 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+/**
+ * Validation of IEC104Config::parse : configurations the plugin could not run with are
+ * rejected with an IEC104ConfigError, the limits themselves are accepted.
+ */
+
+#include <iec104_config.h>
+#include "iec104_test.h"
+
+using namespace std;
+using namespace nlohmann;
+
+
+static json element(unsigned int ca, const char* type_id, unsigned int ioa, const string& label = "P")
+{
+    return {{"ca", ca}, {"type_id", type_id}, {"label", label}, {"ioa", ioa}};
+}
+
+
+/** True when the configuration is rejected with an IEC104ConfigError */
+static bool rejected(const json& asdu_list, const json& application = json::object())
+{
+    try
+    {
+        IEC104Config::parse(testProtocolStack(application), testExchangedData(asdu_list), TEST_TRANSLATION, "{}");
+        return false;
+    }
+    catch (IEC104ConfigError&)
+    {
+        return true;
+    }
+}
+
+
+int main()
+{
+    check(!rejected(json::array({element(1, "M_ME_NC_1", 1, "A"), element(1, "M_SP_NA_1", 1, "B"),
+                                 element(2, "M_ME_NC_1", 1, "C")})),
+          "same IOA under another TypeID or CA accepted");
+
+    check(rejected(json::array({element(1, "M_XX_NA_1", 1)})), "unknown type_id rejected");
+    check(rejected(json::array({element(1, "C_SC_NA_1", 1)})), "command type_id rejected");
+    check(rejected(json::array({element(1, "M_ME_NC_1", 1, "A"), element(1, "M_ME_NC_1", 1, "B")})),
+          "duplicate point rejected");
+    check(rejected(json::array({element(1, "M_ME_NC_1", 1, "")})), "empty label rejected");
+    check(rejected(json::array({{{"ca", 1}, {"type_id", "M_ME_NC_1"}, {"label", "P"}}})), "missing ioa rejected");
+    check(rejected(json::array({{{"ca", "1"}, {"type_id", "M_ME_NC_1"}, {"label", "P"}, {"ioa", 1}}})),
+          "ca of the wrong type rejected");
+
+    // The broadcast address is not a CA of its own
+    check(!rejected(json::array({element(65534, "M_ME_NC_1", 1)})), "ca 65534 accepted with ca_asdu_size 2");
+    check(rejected(json::array({element(65535, "M_ME_NC_1", 1)})), "ca 65535 rejected with ca_asdu_size 2");
+    check(!rejected(json::array({element(254, "M_ME_NC_1", 1)}), {{"ca_asdu_size", 1}}), "ca 254 accepted with ca_asdu_size 1");
+    check(rejected(json::array({element(255, "M_ME_NC_1", 1)}), {{"ca_asdu_size", 1}}), "ca 255 rejected with ca_asdu_size 1");
+
+    check(!rejected(json::array({element(1, "M_ME_NC_1", 16777215)})), "ioa 16777215 accepted with ioaddr_size 3");
+    check(rejected(json::array({element(1, "M_ME_NC_1", 16777216)})), "ioa 16777216 rejected with ioaddr_size 3");
+    check(!rejected(json::array({element(1, "M_ME_NC_1", 65535)}), {{"ioaddr_size", 2}}), "ioa 65535 accepted with ioaddr_size 2");
+    check(rejected(json::array({element(1, "M_ME_NC_1", 65536)}), {{"ioaddr_size", 2}}), "ioa 65536 rejected with ioaddr_size 2");
+
+    check(rejected(json::array({element(1, "M_ME_NC_1", 1)}), {{"tsiv", "KEEP"}}), "unknown tsiv rejected");
+
+    return testResult();
+}
@@ -0,0 +1,66 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+/**
+ * Completion of CP24Time2a time tags with the date of the host clock, in a time zone
+ * with a half-hour offset : the time tag is in local time, or in UTC (utc_time).
+ */
+
+#include <iec104_decoder.h>
+#include <iec104_time_format.h>
+#include "iec104_test.h"
+
+#include <cstdlib>
+#include <ctime>
+
+using namespace std;
+
+typedef IEC104CP24TimeTag<SinglePointWithCP24Time2a, SinglePointWithCP24Time2a_getTimestamp> CP24TimeTag;
+
+/** Epoch in ms of the CP24Time2a time tag of the time expected_ms, in UTC or in local time */
+static int64_t completedTime(int64_t expected_ms, bool utc)
+{
+    time_t seconds = expected_ms / 1000;
+    struct tm fields;
+    if (utc)
+        gmtime_r(&seconds, &fields);
+    else
+        localtime_r(&seconds, &fields);
+
+    sCP24Time2a cp24 = {};
+    CP24Time2a_setMinute(&cp24, fields.tm_min);
+    CP24Time2a_setSecond(&cp24, fields.tm_sec);
+    CP24Time2a_setMillisecond(&cp24, expected_ms % 1000);
+
+    SinglePointWithCP24Time2a io = SinglePointWithCP24Time2a_create(NULL, 1, true, IEC60870_QUALITY_GOOD, &cp24);
+    sCP56Time2a ts;
+    CP24TimeTag::timestamp((InformationObject) io, ts, utc);
+    SinglePointWithCP24Time2a_destroy(io);
+
+    IEC104TimeFormatter formatter;
+    return formatter.toEpochMs(&ts, utc);
+}
+
+
+int main()
+{
+    // UTC+05:30 : an offset of whole hours would hide a time tag completed in the wrong time base
+    setenv("TZ", "Asia/Kolkata", 1);
+    tzset();
+
+    int64_t now = Hal_getTimeInMs();
+
+    check(completedTime(now - 300000, false) == now - 300000, "local time tag 5 minutes ago");
+    check(completedTime(now + 600000, false) == now + 600000, "local time tag 10 minutes ahead");
+    check(completedTime(now - 300000, true) == now - 300000, "UTC time tag 5 minutes ago");
+    check(completedTime(now + 600000, true) == now + 600000, "UTC time tag 10 minutes ahead");
+
+    return testResult();
+}
@@ -0,0 +1,81 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+/**
+ * Deadbands of IEC104PointFilter : absolute, percent of the configured or normalized
+ * range, and integral, with answers to interrogations and quality changes always
+ * forwarded.
+ */
+
+#include <iec104_point_filter.h>
+#include <lib60870/cs104_connection.h>
+#include "iec104_test.h"
+
+#include <chrono>
+#include <thread>
+
+using namespace std;
+using namespace nlohmann;
+
+
+static json element(int ioa, const char* type_id, const json& deadband)
+{
+    return {{"ca", 1}, {"type_id", type_id}, {"label", "P-" + to_string(ioa)}, {"ioa", ioa}, {"deadband", deadband}};
+}
+
+
+int main()
+{
+    json asdu_list = json::array({
+        element(1, "M_ME_NC_1", {{"mode", "absolute"}, {"value", 0.5}}),
+        element(2, "M_ME_NC_1", {{"mode", "percent"}, {"value", 10}, {"range_min", 0}, {"range_max", 400}}),
+        element(3, "M_ME_NA_1", {{"mode", "percent"}, {"value", 10}}),
+        element(4, "M_ME_NC_1", {{"mode", "integral"}, {"value", 1}})
+    });
+    auto config = IEC104Config::parse(testProtocolStack(), testExchangedData(asdu_list), TEST_TRANSLATION, "{}");
+    const IEC104DataPoint& absolute = config->points[0];
+    const IEC104DataPoint& percent = config->points[1];
+    const IEC104DataPoint& normalized = config->points[2];
+    const IEC104DataPoint& integral = config->points[3];
+
+    IEC104PointFilter filter(*config);
+    const int SPONT = CS101_COT_SPONTANEOUS;
+
+    // Absolute : 0.5 from the last forwarded value
+    check(filter.accept(absolute, 0.0, 0, SPONT), "absolute : first value forwarded");
+    check(!filter.accept(absolute, 0.4, 0, SPONT), "absolute : 0.4 from 0 suppressed");
+    check(filter.accept(absolute, 0.6, 0, SPONT), "absolute : 0.6 from 0 forwarded");
+    check(!filter.accept(absolute, 0.9, 0, SPONT), "absolute : 0.3 from 0.6 suppressed");
+    check(filter.accept(absolute, 0.9, 0, CS101_COT_INTERROGATED_BY_STATION), "absolute : interrogated value forwarded");
+    check(filter.accept(absolute, 0.95, IEC60870_QUALITY_INVALID, SPONT), "absolute : quality change forwarded");
+
+    // Percent : 10% of [0, 400] is 40
+    check(filter.accept(percent, 100.0, 0, SPONT), "percent : first value forwarded");
+    check(!filter.accept(percent, 139.0, 0, SPONT), "percent : 39 from 100 suppressed");
+    check(filter.accept(percent, 141.0, 0, SPONT), "percent : 41 from 100 forwarded");
+    check(filter.accept(percent, 142.0, 0, CS101_COT_INTERROGATED_BY_GROUP_1), "percent : group interrogation forwarded");
+
+    // Percent of a normalized value : 10% of [-1, 1] is 0.2
+    check(filter.accept(normalized, 0.0, 0, SPONT), "normalized : first value forwarded");
+    check(!filter.accept(normalized, 0.15, 0, SPONT), "normalized : 0.15 from 0 suppressed");
+    check(filter.accept(normalized, 0.25, 0, SPONT), "normalized : 0.25 from 0 forwarded");
+
+    // Integral : deviation x seconds held, 1 here
+    check(filter.accept(integral, 0.0, 0, SPONT), "integral : first value forwarded");
+    check(!filter.accept(integral, 10.0, 0, SPONT), "integral : deviation not held yet suppressed");
+    this_thread::sleep_for(chrono::milliseconds(200));
+    check(filter.accept(integral, 10.0, 0, SPONT), "integral : deviation of 10 held 200 ms forwarded");
+    check(!filter.accept(integral, 10.5, 0, SPONT), "integral : integral reset once forwarded");
+
+    check(filter.suppressed() == 6, "suppressed values counted");
+    check(filter.forwarded() == 11, "forwarded values counted");
+
+    return testResult();
+}
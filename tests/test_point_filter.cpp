@@ -0,0 +1,41 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+/**
+ * Unchanged value suppression of IEC104PointFilter : a value forwarded under a COT
+ * class that is not suppressed is the reference of the next comparisons.
+ */
+
+#include <iec104_point_filter.h>
+#include <lib60870/cs104_connection.h>
+#include "iec104_test.h"
+
+using namespace std;
+using namespace nlohmann;
+
+
+int main()
+{
+    auto config = IEC104Config::parse(testProtocolStack({{"suppress_unchanged", json::array({"spontaneous"})}}),
+                                      testExchangedData(json::array({{{"ca", 1}, {"type_id", "M_ME_NC_1"}, {"label", "P-1"}, {"ioa", 1}}})),
+                                      TEST_TRANSLATION, "{}");
+    const IEC104DataPoint& point = config->points[0];
+
+    IEC104PointFilter filter(*config);
+    const double A = 1.0, B = 2.0;
+
+    check(filter.accept(point, B, 0, CS101_COT_SPONTANEOUS), "first spontaneous B forwarded");
+    check(!filter.accept(point, B, 0, CS101_COT_SPONTANEOUS), "unchanged spontaneous B suppressed");
+    check(filter.accept(point, A, 0, CS101_COT_INTERROGATED_BY_STATION), "interrogated A forwarded");
+    check(filter.accept(point, B, 0, CS101_COT_SPONTANEOUS), "spontaneous B after interrogated A forwarded");
+    check(!filter.accept(point, B, 0, CS101_COT_SPONTANEOUS), "unchanged spontaneous B suppressed again");
+
+    return testResult();
+}
@@ -0,0 +1,92 @@
+/*
+ * Fledge IEC 104 south plugin.
+ *
+ * Copyright (c) 2020, RTE (https://www.rte-france.com)
+ *
+ * Released under the Apache 2.0 Licence
+ *
+ * Author: Estelle Chigot, Lucas Barret, Chauchadis Rémi, Colin Constans, Akli Rahmoun
+ */
+
+/**
+ * IEC104TimeFormatter : every field zero padded, and the cached "YYYY-MM-DD HH:MM"
+ * prefix and epoch of the minute replaced as soon as a time tag leaves that minute.
+ * Local time tags of the hour repeated at the end of summer time are told apart by
+ * their SU bit.
+ */
+
+#include <iec104_time_format.h>
+#include "iec104_test.h"
+
+#include <cstdlib>
+#include <ctime>
+#include <string>
+
+using namespace std;
+
+
+/** Epoch in ms of a UTC date */
+static uint64_t utcMs(int year, int month, int day, int hour, int minute, int second, int ms)
+{
+    struct tm tm = {};
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+    tm.tm_sec = second;
+    return (uint64_t) timegm(&tm) * 1000 + ms;
+}
+
+
+/** Format the time tag of epoch_ms with formatter, check the text and its UTC epoch */
+static void checkTime(IEC104TimeFormatter& formatter, uint64_t epoch_ms, const string& expected)
+{
+    sCP56Time2a ts;
+    CP56Time2a_createFromMsTimestamp(&ts, epoch_ms);
+
+    char out[IEC104TimeFormatter::LENGTH];
+    size_t length = formatter.format(&ts, out);
+    check(length == IEC104TimeFormatter::LENGTH && string(out, length) == expected, (expected + " formatted").c_str());
+    check(formatter.toEpochMs(&ts, true) == (int64_t) epoch_ms, (expected + " converted to epoch").c_str());
+}
+
+
+int main()
+{
+    IEC104TimeFormatter formatter;
+
+    // Single digit fields
+    checkTime(formatter, utcMs(2021, 3, 4, 5, 6, 7, 8), "2021-03-04 05:06:07.008");
+    checkTime(formatter, utcMs(2021, 3, 4, 5, 6, 0, 0), "2021-03-04 05:06:00.000");
+    checkTime(formatter, utcMs(2021, 3, 4, 5, 6, 59, 999), "2021-03-04 05:06:59.999");
+
+    // Leaving the minute, by a minute, an hour, a day, a month or a year
+    checkTime(formatter, utcMs(2021, 3, 4, 5, 7, 0, 10), "2021-03-04 05:07:00.010");
+    checkTime(formatter, utcMs(2021, 3, 4, 6, 7, 0, 10), "2021-03-04 06:07:00.010");
+    checkTime(formatter, utcMs(2021, 3, 5, 6, 7, 0, 10), "2021-03-05 06:07:00.010");
+    checkTime(formatter, utcMs(2021, 4, 5, 6, 7, 0, 10), "2021-04-05 06:07:00.010");
+    checkTime(formatter, utcMs(2022, 4, 5, 6, 7, 0, 10), "2022-04-05 06:07:00.010");
+
+    // Back to an earlier minute, and two digit fields
+    checkTime(formatter, utcMs(2021, 3, 4, 5, 6, 7, 8), "2021-03-04 05:06:07.008");
+    checkTime(formatter, utcMs(2099, 12, 31, 23, 59, 58, 123), "2099-12-31 23:59:58.123");
+
+    // Europe/Paris leaves summer time on 2021-10-31 at 03:00 CEST, 01:00 UTC : 02:30 happens twice
+    setenv("TZ", "Europe/Paris", 1);
+    tzset();
+
+    sCP56Time2a ts;
+    CP56Time2a_createFromMsTimestamp(&ts, utcMs(2021, 10, 31, 2, 30, 0, 0));
+    CP56Time2a_setSummerTime(&ts, true);
+    check(formatter.toEpochMs(&ts, false) == (int64_t) utcMs(2021, 10, 31, 0, 30, 0, 0), "02:30 CEST is 00:30 UTC");
+    CP56Time2a_setSummerTime(&ts, false);
+    check(formatter.toEpochMs(&ts, false) == (int64_t) utcMs(2021, 10, 31, 1, 30, 0, 0), "02:30 CET is 01:30 UTC");
+
+    CP56Time2a_createFromMsTimestamp(&ts, utcMs(2021, 7, 1, 12, 0, 0, 0));
+    CP56Time2a_setSummerTime(&ts, true);
+    check(formatter.toEpochMs(&ts, false) == (int64_t) utcMs(2021, 7, 1, 10, 0, 0, 0), "12:00 CEST in July is 10:00 UTC");
+    check(formatter.toEpochMs(&ts, true) == (int64_t) utcMs(2021, 7, 1, 12, 0, 0, 0), "SU bit ignored for UTC time tags");
+
+    return testResult();
+}